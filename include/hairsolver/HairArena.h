@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+
+// Bump allocator for per-step scratch buffers. Stages take uninitialized
+// storage with allocate() and never free it; reset() at the start of the
+// next step releases everything at once. When a step outgrows the current
+// block, more blocks are chained, and the next reset() merges them into one
+// block of the high-water size, so after warm-up a step never allocates.
+// Allocation is not thread-safe: take buffers before the parallel loops.
+class HairArena {
+public:
+	HairArena();
+	~HairArena();
+	// Scratch is not state: copies start empty.
+	HairArena(const HairArena &);
+	HairArena &operator=(const HairArena &);
+
+	void *allocate(size_t bytes, size_t alignment = 64);
+	// Storage for n trivially destructible T (floats, Eigen fixed-size types, ...).
+	template <typename T>
+	T *allocate(size_t n) { return static_cast<T *>(allocate(n * sizeof(T), alignof(T) > 64 ? alignof(T) : 64)); }
+
+	void reset();
+	// Makes sure the first block holds at least bytes.
+	void reserve(size_t bytes);
+
+	size_t used() const { return mUsedBefore + mOffset; }
+	size_t capacity() const;
+	size_t highWaterMark() const { return mHighWaterMark; }
+	// Blocks allocated since construction; constant in steady state.
+	unsigned int numBlockAllocations() const { return mNumBlockAllocations; }
+
+private:
+	struct Block {
+		Block *next;
+		size_t size;
+	};
+
+	char *blockData(Block *b) const { return (char *)b + sizeof(Block); }
+	void addBlock(size_t minBytes);
+	void release();
+
+	Block *mFirst;
+	Block *mCurrent;
+	size_t mOffset;
+	size_t mUsedBefore;
+	size_t mHighWaterMark;
+	unsigned int mNumBlockAllocations;
+};
+
+// Debug check for allocation-free stepping. In builds with HAIR_HEAP_GUARD
+// defined, any global operator new on a thread while a guard is alive on
+// that thread prints the scope and aborts; the solver opens guards inside
+// its parallel loops so worker threads are covered too. Also define
+// EIGEN_RUNTIME_NO_MALLOC to catch Eigen's own allocations (dynamic
+// resizes); that flag is process wide and stays cleared while any thread
+// is guarded. Without HAIR_HEAP_GUARD the guard does nothing.
+class HairHeapGuard {
+public:
+#ifdef HAIR_HEAP_GUARD
+	explicit HairHeapGuard(const char *scope);
+	~HairHeapGuard();
+#else
+	explicit HairHeapGuard(const char *) {}
+#endif
+
+private:
+	HairHeapGuard(const HairHeapGuard &);
+	HairHeapGuard &operator=(const HairHeapGuard &);
+
+#ifdef HAIR_HEAP_GUARD
+	const char *mPreviousScope;
+#endif
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <Eigen/Core>
+#include "HairMappedFile.h"
+
+class HairDoF;
+
+// Simulation frame cache (.hcache)
+//
+//   HairCacheHeader                       64 bytes
+//   topology       int32[numStrands + 1]  64-byte aligned
+//   frame blocks   float[3 * numPoints] positions, then optionally
+//                  float[4 * numPoints] quaternions (x, y, z, w),
+//                  each 64-byte aligned
+//   frame index    HairCacheFrameEntry[numFrames]
+//
+// The index is written last, so frames can be appended while simulating.
+// Raw frames are read as zero-copy views straight into the mapping.
+// DeltaChunk frames share one HairCodec chunk (all of its index entries
+// point at the same offset) and must be decoded through loadFrame().
+struct HairCacheHeader {
+	enum Flags { HasQuaternions = 1 };
+	enum Encoding { Raw = 0, DeltaChunk = 1 };
+
+	char magic[8];
+	uint32_t version;
+	uint32_t flags;
+	uint32_t numStrands;
+	uint32_t numPoints;
+	uint64_t topologyOffset;
+	uint64_t indexOffset;
+	uint64_t numFrames;
+	uint8_t reserved[16];
+};
+
+struct HairCacheFrameEntry {
+	uint64_t offset;
+	uint64_t size;
+	float time;
+	uint32_t encoding;
+};
+
+class HairCacheWriter {
+public:
+	HairCacheWriter();
+	~HairCacheWriter();
+
+	bool open(const std::string &filename, HairDoF &dof, bool storeQuaternions);
+	bool writeFrame(HairDoF &dof, float time);
+	// Appends an already encoded block holding numFrames consecutive frames.
+	bool writeChunk(const char *data, size_t size, const float *times, unsigned int numFrames, uint32_t encoding);
+	// Writes the frame index; the file is unreadable until this is called.
+	void close();
+
+	bool isOpen() const { return mFile.is_open(); }
+	unsigned int numFrames() const { return (unsigned int)mIndex.size(); }
+	unsigned int numPoints() const { return mHeader.numPoints; }
+	uint64_t bytesWritten() { return mFile.is_open() ? (uint64_t)mFile.tellp() : 0; }
+
+private:
+	void pad();
+
+	std::ofstream mFile;
+	HairCacheHeader mHeader;
+	std::vector<HairCacheFrameEntry> mIndex;
+	std::vector<float> mScratch;
+};
+
+class HairCacheReader {
+public:
+	HairCacheReader();
+
+	// Checks the index and topology against the file; frames are checked as they are read.
+	bool open(const std::string &filename);
+	void close();
+
+	bool isOpen() const { return mHeader != nullptr; }
+	unsigned int numFrames() const { return mHeader ? (unsigned int)mHeader->numFrames : 0; }
+	unsigned int numPoints() const { return mHeader ? mHeader->numPoints : 0; }
+	unsigned int numStrands() const { return mHeader ? mHeader->numStrands : 0; }
+	bool hasQuaternions() const { return mHeader && (mHeader->flags & HairCacheHeader::HasQuaternions); }
+
+	float frameTime(unsigned int frame) const;
+	Eigen::Map<const Eigen::VectorXi> topology() const;
+	// Zero-copy views; empty for frames that are not stored raw.
+	Eigen::Map<const Eigen::Matrix3Xf> positions(unsigned int frame) const;
+	Eigen::Map<const Eigen::Matrix4Xf> quaternions(unsigned int frame) const;
+
+	// Copies a frame into dof, rebuilding its topology if the point count differs.
+	bool loadFrame(unsigned int frame, HairDoF &dof) const;
+	void prefetch(unsigned int frame) const;
+
+private:
+	// Null unless frame is stored raw and its entry covers the whole frame.
+	const float *frameData(unsigned int frame) const;
+	uint64_t quaternionOffset() const;
+
+	HairMappedFile mMapping;
+	const HairCacheHeader *mHeader;
+	const HairCacheFrameEntry *mIndex;
+};
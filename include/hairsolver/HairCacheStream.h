@@ -0,0 +1,85 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "HairCache.h"
+
+// Asynchronous, compressed cache writer. push() copies a finished frame into a
+// bounded queue and returns; worker threads encode chunks of consecutive
+// frames with HairCodec and append them to the cache in order. The solver
+// thread only waits when every queue slot still holds an unencoded frame.
+class HairCacheStreamWriter {
+public:
+	struct Stats {
+		unsigned int frames;
+		uint64_t rawBytes;
+		uint64_t compressedBytes;
+		double encodeSeconds;
+		double stallSeconds;
+		double wallSeconds;
+
+		double compressionRatio() const { return compressedBytes ? (double)rawBytes / (double)compressedBytes : 0.0; }
+		// Raw frame data accepted per second of wall time.
+		double throughputMBs() const { return wallSeconds > 0 ? (double)rawBytes / (wallSeconds * 1024.0 * 1024.0) : 0.0; }
+	};
+
+	HairCacheStreamWriter();
+	~HairCacheStreamWriter();
+
+	bool open(const std::string &filename, HairDoF &dof, bool storeQuaternions,
+		unsigned int numWorkers = 2, unsigned int chunkFrames = 8, unsigned int maxQueuedFrames = 32);
+	bool push(HairDoF &dof, float time);
+	// Drains the queue, writes the index and prints throughput and compression ratio.
+	void close();
+
+	bool isOpen() const { return mOpen; }
+	Stats stats();
+
+	// Quantization steps, in scene units and quaternion units.
+	float mPositionPrecision;
+	float mQuaternionPrecision;
+
+private:
+	struct ChunkJob {
+		unsigned int chunkId;
+		std::vector<unsigned int> slots;
+		std::vector<float> times;
+	};
+	struct EncodedChunk {
+		std::vector<char> data;
+		std::vector<float> times;
+	};
+
+	void submitChunk();
+	void workerLoop();
+
+	HairCacheWriter mWriter;
+	bool mOpen;
+	bool mStoreQuaternions;
+	unsigned int mChunkFrames;
+	unsigned int mNumPoints;
+
+	std::vector<std::vector<float> > mSlots;
+	std::vector<unsigned int> mFreeSlots;
+	std::deque<ChunkJob> mJobs;
+	ChunkJob mCurrent;
+	unsigned int mNextChunkId;
+	bool mStopping;
+	std::mutex mMutex;
+	std::condition_variable mSlotFreed, mJobReady;
+	std::vector<std::thread> mWorkers;
+
+	//encoded chunks wait here until all earlier chunks are on disk
+	std::map<unsigned int, EncodedChunk> mPending;
+	unsigned int mNextChunkToWrite;
+	std::mutex mOutputMutex;
+
+	Stats mStats;
+	std::chrono::steady_clock::time_point mOpenTime;
+};
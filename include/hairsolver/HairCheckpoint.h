@@ -0,0 +1,95 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "HairSolver.h"
+
+// Solver checkpoint (.hckpt)
+//
+//   HairCheckpointHeader                       model state and array offsets
+//   topology     int32[numStrands + 1]         64-byte aligned
+//   types        int32[numPoints]              64-byte aligned
+//   dof          float[vertexSize * numPoints] 64-byte aligned
+//   dofPrev      float[vertexSize * numPoints] 64-byte aligned
+//   roots        float[vertexSize * numRoots]  optional, 64-byte aligned
+//   rootsPrev    float[vertexSize * numRoots]  optional, 64-byte aligned
+//
+// Arrays are stored as raw bits, one write each, so a restored solver
+// continues bit-identically to one that never stopped.
+struct HairCheckpointHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t vertexSize;
+	uint32_t numStrands;
+	uint32_t numPoints;
+	uint32_t numRoots;
+	float hairRadius;
+
+	float timestep;
+	float gravity;
+	float segmentLength;
+	uint32_t stiffness;
+	float rotFreq[3];
+	float rotAmp[3];
+	float currentTime;
+	uint32_t transform;
+	uint32_t deterministic;
+	float rootRotation[4];
+	float currentRootRotation[4];
+
+	uint64_t topologyOffset;
+	uint64_t typesOffset;
+	uint64_t dofOffset;
+	uint64_t dofPrevOffset;
+	uint64_t rootsOffset;
+	uint64_t rootsPrevOffset;
+	uint64_t fileSize;
+};
+
+class HairCheckpoint {
+public:
+	// roots (as filled by copyRootsFromHair) are optional on both sides.
+	static bool save(const std::string &filename, const HairModel &model, HairDoF &dof, HairDoF *roots = nullptr);
+	static bool load(const std::string &filename, HairModel &model, HairDoF &dof, HairDoF *roots = nullptr);
+
+	// Fills the header (model state and layout) for this state; false if
+	// roots do not match dof.
+	static bool describe(const HairModel &model, HairDoF &dof, HairDoF *roots, HairCheckpointHeader &header);
+};
+
+// Asynchronous checkpoints: snapshot() copies the state into a buffer with
+// the file layout (parallel memcpy) and returns, and a background thread
+// writes the buffer. The solver only waits if the previous checkpoint is
+// still being written when the next one is taken.
+class HairCheckpointWriter {
+public:
+	HairCheckpointWriter();
+	~HairCheckpointWriter();
+
+	bool snapshot(const std::string &filename, const HairModel &model, HairDoF &dof, HairDoF *roots = nullptr);
+	// Blocks until the last snapshot is on disk; false if writing it failed.
+	bool wait();
+
+	// Solver thread time in the last snapshot(), and the part of it spent
+	// waiting for the previous write.
+	double mCopySeconds;
+	double mStallSeconds;
+	// Background time of the last completed write.
+	double mWriteSeconds;
+
+private:
+	void writerLoop();
+
+	std::vector<char> mBuffer;
+	std::string mFilename;
+	bool mPending;
+	bool mFailed;
+	bool mStopping;
+	std::mutex mMutex;
+	std::condition_variable mCondition;
+	std::thread mThread;
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Lossy frame codec for hair caches. A chunk holds consecutive frames:
+// positions are quantized on a grid anchored at the bounding box minimum of
+// the first frame, quaternions on a fixed grid. The first frame is predicted
+// along the point order, the next ones linearly from the previous two frames,
+// and the residuals are entropy coded with an adaptive binary range coder.
+// Chunks are independent, so they can be encoded in parallel; decoding a
+// frame decodes the frames before it in the same chunk.
+class HairCodec {
+public:
+	struct ChunkHeader {
+		uint32_t numFrames;
+		uint32_t numPoints;
+		uint32_t hasQuaternions;
+		float positionStep;
+		float quaternionStep;
+		float origin[3];
+	};
+
+	// frames[k] is one packed frame: float[3 * numPoints] positions followed,
+	// if hasQuaternions, by float[4 * numPoints] quaternions.
+	static void encodeChunk(const float *const *frames, unsigned int numFrames, unsigned int numPoints, bool hasQuaternions,
+		float positionStep, float quaternionStep, std::vector<char> &out);
+
+	// Decodes frame frameInChunk into buffers of numPoints points; quaternions
+	// may be null. False if the chunk does not hold frames of numPoints points
+	// with (or without) quaternions.
+	static bool decodeFrame(const char *chunk, size_t size, unsigned int frameInChunk, unsigned int numPoints, bool hasQuaternions, float *positions, float *quaternions);
+
+	static unsigned int frameFloats(unsigned int numPoints, bool hasQuaternions) { return numPoints * (hasQuaternions ? 7 : 3); }
+};
@@ -1,10 +1,85 @@
 #pragma once
 
 #include "HairGeo.h"
+#include "HairParallel.h"
+#include "HairRandom.h"
+#include "HairScalp.h"
+#include <algorithm>
 #include <vector>
 
+class HairScalpParams {
+public:
+	HairScalpParams();
+
+	unsigned int seed;
+	unsigned int numHairs;
+	unsigned int numPointsPerHair;
+	float hairLength;
+	// Strand length is hairLength * (1 - lengthVariation * u), u uniform in [0, 1).
+	float lengthVariation;
+	// Poisson-disk roots instead of independent area-weighted samples. Fewer
+	// than numHairs strands are returned if the scalp saturates first.
+	bool blueNoise;
+	// Minimum root distance for blueNoise; 0 derives it from area and numHairs.
+	float poissonRadius;
+};
+
 class HairCreator {
 public:
 	static HairGeo createRadialHair(unsigned int seed, unsigned int numHairs, unsigned int numPointsPerHair, float hairLength);
+	// Strands grown along the scalp normals from roots sampled by area (times
+	// density) through an alias table. Root triangles and barycentrics go to binding.
+	static HairGeo createScalpHair(const HairScalp &scalp, const HairScalpParams &params, HairRootBinding *binding = nullptr);
+
+	// Grows or truncates a createRadialHair groom to numHairs strands. Existing
+	// strands are kept, and new strand i is the one createRadialHair would give.
+	static void resizeRadialHair(HairGeo &geo, unsigned int seed, unsigned int numHairs, unsigned int numPointsPerHair, float hairLength);
+
+	// Parallel groom generation. Strand i draws only from the random stream
+	// (seed, i) and writes only its own points, so the output is identical for
+	// any thread count. generator(strandId, random, points, numPoints) fills
+	// points[0 .. numPoints).
+	template <typename StrandGenerator>
+	static HairGeo generate(unsigned int seed, const std::vector<unsigned int> &pointsPerStrand, StrandGenerator generator) {
+		HairGeo geo;
+		append(geo, seed, pointsPerStrand, generator);
+		return geo;
+	}
+
+	// Adds strands numStrands() .. numStrands() + pointsPerStrand.size() to geo,
+	// the same strands generate() would produce at those ids.
+	template <typename StrandGenerator>
+	static void append(HairGeo &geo, unsigned int seed, const std::vector<unsigned int> &pointsPerStrand, StrandGenerator generator) {
+		int firstStrand = (int)geo.numStrands();
+		int nStrands = (int)pointsPerStrand.size();
+		if (nStrands == 0) return;
+
+		if (geo.offsets.empty()) geo.offsets.push_back(0);
+		geo.offsets.resize(firstStrand + nStrands + 1);
+		std::copy(pointsPerStrand.begin(), pointsPerStrand.end(), geo.offsets.begin() + firstStrand + 1);
+		geo.offsets[firstStrand + 1] += geo.offsets[firstStrand];
+		HairParallel::inclusiveScan(geo.offsets.data() + firstStrand + 1, nStrands);
+
+		//new points are left uninitialized, so the pages are first touched by the generating threads
+		geo.points.resize(geo.offsets[firstStrand + nStrands]);
+
+		HairRandom rng(seed);
+		Eigen::Vector3f *points = geo.points.data();
+		const unsigned int *offsets = geo.offsets.data();
+
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < nStrands; i++) {
+			int strandId = firstStrand + i;
+			HairRandom::Stream random = rng.stream(strandId);
+			generator((unsigned int)strandId, random, points + offsets[strandId], offsets[strandId + 1] - offsets[strandId]);
+		}
+
+		geo.resetIter();
+		geo.update();
+	}
 
-};
\ No newline at end of file
+	template <typename StrandGenerator>
+	static HairGeo generate(unsigned int seed, unsigned int numHairs, unsigned int numPointsPerHair, StrandGenerator generator) {
+		return generate(seed, std::vector<unsigned int>(numHairs, numPointsPerHair), generator);
+	}
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <Eigen/Core>
+
+// Solver array that either owns its storage or aliases external memory (a
+// moved-in groom, a shared memory segment, ...). It is an Eigen::Map in both
+// cases, so solver code reads and writes it like a vector. Copies always own
+// their data. Owned storage is only reallocated to grow, like std::vector.
+template <typename Scalar>
+class HairDoFArray : public Eigen::Map<Eigen::Matrix<Scalar, Eigen::Dynamic, 1> > {
+public:
+	typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> Vector;
+	typedef Eigen::Map<Vector> Base;
+	using Base::operator=;
+
+	HairDoFArray() : Base(nullptr, 0) {}
+	HairDoFArray(const HairDoFArray &o) : Base(nullptr, 0), mStorage(o) { rebind(mStorage.data(), mStorage.size()); }
+	HairDoFArray(HairDoFArray &&o) : Base(nullptr, 0) { *this = std::move(o); }
+
+	HairDoFArray &operator=(const HairDoFArray &o) {
+		if (this != &o) {
+			resize(o.size());
+			Base::operator=(o);
+		}
+		return *this;
+	}
+	HairDoFArray &operator=(HairDoFArray &&o) {
+		if (this != &o) {
+			Scalar *data = o.data();
+			Eigen::Index n = o.size();
+			mStorage = std::move(o.mStorage);
+			mOwner = std::move(o.mOwner);
+			rebind(data, n);
+			o.mStorage.resize(0);
+			o.rebind(nullptr, 0);
+		}
+		return *this;
+	}
+
+	// The values are undefined after resizing.
+	void resize(Eigen::Index n) {
+		if (n == this->size()) return;
+		if (mOwner || n > mStorage.size()) {
+			mOwner.reset();
+			mStorage.resize(n);
+		}
+		rebind(mStorage.data(), n);
+	}
+
+	// Keeps the first min(n, size()) values. Growing reserves 50% extra, so
+	// repeated appends copy each value a constant number of times.
+	void conservativeResize(Eigen::Index n) {
+		if (n == this->size()) return;
+		if (!mOwner && n <= mStorage.size()) {
+			rebind(mStorage.data(), n);
+			return;
+		}
+		Eigen::Index keep = std::min(n, (Eigen::Index)this->size());
+		Vector storage(mOwner ? n : std::max(n, mStorage.size() + mStorage.size() / 2));
+		storage.head(keep) = Base::head(keep);
+		mStorage.swap(storage);
+		mOwner.reset();
+		rebind(mStorage.data(), n);
+	}
+
+	Eigen::Index capacity() const { return mOwner ? this->size() : mStorage.size(); }
+
+	// Views n values at data; owner keeps that memory alive.
+	void alias(Scalar *data, Eigen::Index n, std::shared_ptr<void> owner) {
+		mStorage.resize(0);
+		mOwner = owner;
+		rebind(data, n);
+	}
+
+	bool isAliased() const { return mOwner != nullptr; }
+
+private:
+	void rebind(Scalar *data, Eigen::Index n) { new (static_cast<Base *>(this)) Base(data, n); }
+
+	Vector mStorage;
+	std::shared_ptr<void> mOwner;
+};
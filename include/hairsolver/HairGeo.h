@@ -17,6 +17,31 @@ public:
 	HairSegment();
 };
 
+// Contiguous points of one strand. t(i) is the same root-to-tip parameter
+// that HairVertex::t reports.
+template <typename T>
+class HairStrandSpan {
+public:
+	HairStrandSpan(T *data, unsigned int firstPoint, unsigned int size) : mData(data), mFirstPoint(firstPoint), mSize(size) {}
+	template <typename U>
+	HairStrandSpan(const HairStrandSpan<U> &o) : mData(o.begin()), mFirstPoint(o.firstPoint()), mSize(o.size()) {}
+
+	T *begin() const { return mData; }
+	T *end() const { return mData + mSize; }
+	T &operator[](unsigned int i) const { return mData[i]; }
+	unsigned int size() const { return mSize; }
+	unsigned int firstPoint() const { return mFirstPoint; }
+	float t(unsigned int i) const { return (float)i / (float)mSize; }
+
+private:
+	T *mData;
+	unsigned int mFirstPoint;
+	unsigned int mSize;
+};
+
+typedef HairStrandSpan<Eigen::Vector3f> HairStrand;
+typedef HairStrandSpan<const Eigen::Vector3f> ConstHairStrand;
+
 class HairGeo {
 public:
 	unsigned int pointIter, strandIter;
@@ -38,7 +63,69 @@ public:
 	void resetIter();
 	void resize(std::vector<unsigned int> &offs);
 
-	unsigned int numSegments() const;
+	// Keeps the first numStrands strands (see HairCreator::append to add strands).
+	void truncate(unsigned int numStrands);
+	// Resamples every strand to pointsPerStrand points along its current shape
+	// (see resampleStrand), strands in parallel.
+	void resample(unsigned int pointsPerStrand, float spacing = 0);
+
+	// Places m points spacing apart along the polyline of n points at src,
+	// continuing past the tip along the last segment; spacing 0 spreads them
+	// over the whole polyline. Points are 3 floats, stride floats apart.
+	static void resampleStrand(const float *src, unsigned int n, unsigned int srcStride, float *dst, unsigned int m, unsigned int dstStride, float spacing = 0);
+
+	// Recomputes the cached segment count; call after editing offsets directly.
+	void update();
+
+	unsigned int numSegments() const { return mNumSegments; }
 	unsigned int numPoints() const;
 	unsigned int numStrands() const;
+
+	HairStrand strand(unsigned int i) { return HairStrand(points.data() + offsets[i], offsets[i], offsets[i + 1] - offsets[i]); }
+	ConstHairStrand strand(unsigned int i) const { return ConstHairStrand(points.data() + offsets[i], offsets[i], offsets[i + 1] - offsets[i]); }
+
+	// f(strandId, strand), strands in parallel.
+	template <typename F>
+	void forEachStrand(F f) {
+		int nStrands = (int)numStrands();
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < nStrands; i++) f((unsigned int)i, strand(i));
+	}
+
+	template <typename F>
+	void forEachStrand(F f) const {
+		int nStrands = (int)numStrands();
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < nStrands; i++) f((unsigned int)i, strand(i));
+	}
+
+	// f(segmentId, pointA, pointB), segments numbered in the order operator>>(HairSegment&) returns them.
+	template <typename F>
+	void forEachSegment(F f) const {
+		int nStrands = (int)numStrands();
+		if (nStrands == 0) return;
+
+		//with no empty strands, strand i starts at segment offsets[i] - i
+		std::vector<unsigned int> segmentOffsets;
+		if (mHasEmptyStrands) {
+			segmentOffsets.resize(nStrands);
+			unsigned int n = 0;
+			for (int i = 0; i < nStrands; i++) {
+				segmentOffsets[i] = n;
+				if (offsets[i + 1] > offsets[i]) n += offsets[i + 1] - offsets[i] - 1;
+			}
+		}
+
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < nStrands; i++) {
+			unsigned int first = offsets[i];
+			unsigned int end = offsets[i + 1];
+			unsigned int segmentId = mHasEmptyStrands ? segmentOffsets[i] : first - i;
+			for (unsigned int p = first; p + 1 < end; p++) f(segmentId++, p, p + 1);
+		}
+	}
+
+private:
+	unsigned int mNumSegments;
+	bool mHasEmptyStrands;
 };
\ No newline at end of file
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <Eigen/Core>
+#include "HairGeo.h"
+#include "HairMappedFile.h"
+
+// Native groom file (.hgroom)
+//
+//   HairGroomHeader                                64 bytes
+//   offsets      uint32[numStrands + 1]            64-byte aligned
+//   points       float[3 * numPoints]              64-byte aligned
+//   attributes   HairGroomAttributeEntry[numAttributes]
+//   attribute    float[components * numStrands]    64-byte aligned, per entry
+//
+// The arrays have the in-memory layout of HairGeo::offsets and
+// HairGeo::points, so loading is a mapping plus (at most) a block copy.
+struct HairGroomHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t numStrands;
+	uint64_t numPoints;
+	uint64_t offsetsOffset;
+	uint64_t pointsOffset;
+	uint64_t attributesOffset;
+	uint32_t numAttributes;
+	uint32_t reserved[3];
+};
+
+struct HairGroomAttributeEntry {
+	char name[32];
+	uint32_t components;
+	uint32_t reserved;
+	uint64_t offset;
+};
+
+// Per-strand attribute, e.g. "thickness" (1) or "color" (3); values holds
+// components * numStrands floats, strand-major.
+struct HairGroomAttribute {
+	std::string name;
+	unsigned int components;
+	std::vector<float> values;
+};
+
+class HairGroomFile {
+public:
+	HairGroomFile();
+
+	static bool write(const std::string &filename, const HairGeo &geo, const std::vector<HairGroomAttribute> &attributes = std::vector<HairGroomAttribute>());
+
+	bool open(const std::string &filename);
+	void close();
+
+	bool isOpen() const { return mHeader != nullptr; }
+	unsigned int numStrands() const { return mHeader ? mHeader->numStrands : 0; }
+	unsigned int numPoints() const { return mHeader ? (unsigned int)mHeader->numPoints : 0; }
+
+	// Zero-copy views into the mapping.
+	const unsigned int *offsets() const;
+	const Eigen::Vector3f *points() const;
+	Eigen::Map<const Eigen::Matrix3Xf> pointMatrix() const;
+	// Empty if the groom has no attribute with this name.
+	Eigen::Map<const Eigen::MatrixXf> attribute(const std::string &name) const;
+
+	// Block-copies offsets and points into geo, in parallel.
+	bool load(HairGeo &geo) const;
+
+private:
+	HairMappedFile mMapping;
+	const HairGroomHeader *mHeader;
+};
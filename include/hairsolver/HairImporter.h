@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "HairGeo.h"
+#include "HairGroom.h"
+
+class HairImporter {
+public:
+	// Cem Yuksel's .hair format, with or without the per-strand segments array.
+	// The file is streamed in fixed-size chunks: points are read directly into
+	// geo.points by parallel readers, offsets come from a parallel prefix sum.
+	// If attributes is given, per-point thickness and color present in the file
+	// are averaged into per-strand "thickness" and "color" attributes.
+	static bool loadCyHair(const std::string &filename, HairGeo &geo, std::vector<HairGroomAttribute> *attributes = nullptr);
+};
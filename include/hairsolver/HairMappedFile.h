@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+// Read-only memory mapping of a whole file. Pages are faulted in on access, so
+// opening is O(1) in the file size.
+class HairMappedFile {
+public:
+	HairMappedFile();
+	~HairMappedFile();
+
+	bool open(const std::string &filename);
+	void close();
+
+	// Hint that [offset, offset + size) will be read soon.
+	void prefetch(size_t offset, size_t size) const;
+
+	bool isOpen() const { return mData != nullptr; }
+	const char *data() const { return mData; }
+	size_t size() const { return mSize; }
+
+private:
+	HairMappedFile(const HairMappedFile &) = delete;
+	HairMappedFile & operator= (const HairMappedFile &) = delete;
+
+	const char *mData;
+	size_t mSize;
+#if defined(_WIN32)
+	void *mFile;
+	void *mMapping;
+#else
+	int mFd;
+#endif
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <ostream>
+#include <vector>
+#include <Eigen/Core>
+#include "HairSolver.h"
+
+// Render geometry for export: camera-facing ribbons or N-sided tubes around
+// the strands of a HairDoF, with normals and UVs (u across the ribbon or
+// around the tube, v from root to tip).
+//
+// layout() depends only on the topology: it counts the vertices and indices
+// of every strand and turns the counts into per-strand offsets with a prefix
+// sum. build() then writes each strand into its own range of preallocated
+// buffers, strands in parallel, so a shot is meshed with one layout() and
+// one build() per frame.
+//
+// Tubes follow the material frames of HairDoF_PointsAndQuaternions, so they
+// twist with the solver's frames (the ring starts at q * y, the solver's
+// tangent being q * x); point-only DoFs use a frame transported along the
+// strand instead. Strands of fewer than two points produce no geometry.
+class HairMesh {
+public:
+	enum Type {
+		Ribbons,
+		Tubes
+	};
+
+	HairMesh();
+
+	void layout(HairDoF &dof);
+	// Buffers hold numVertices() positions and normals (3 floats), uvs (2
+	// floats) and numIndices() triangle indices; normals and uvs may be null.
+	// False if dof's topology is not the one of the last layout().
+	bool build(HairDoF &dof, float *positions, float *normals, float *uvs, unsigned int *indices) const;
+	// layout() and build() into the mesh's own arrays.
+	bool generate(HairDoF &dof);
+
+	// Wavefront OBJ of the mesh's own arrays.
+	bool writeObj(std::ostream &out) const;
+
+	unsigned int sides() const { return mSides < 3 ? 3 : mSides; }
+	unsigned int vertsPerPoint() const { return mType == Tubes ? sides() + 1 : 2; }
+	unsigned int indicesPerSegment() const { return mType == Tubes ? 6 * sides() : 6; }
+	unsigned int numVertices() const { return mVertexOffsets.empty() ? 0 : mVertexOffsets.back(); }
+	unsigned int numIndices() const { return mIndexOffsets.empty() ? 0 : mIndexOffsets.back(); }
+
+	Type mType;
+	// Sides of a tube (3 to 64); the ring repeats its first vertex for the UV seam.
+	unsigned int mSides;
+	// Half width of a ribbon, radius of a tube, scaled by mTipScale at the tip.
+	float mRadius;
+	float mTipScale;
+	// Ribbons turn towards mCameraPosition, or with mOrthographic towards the
+	// direction mCameraPosition.
+	Eigen::Vector3f mCameraPosition;
+	bool mOrthographic;
+
+	// First vertex and index of each strand, numStrands + 1 entries.
+	std::vector<unsigned int> mVertexOffsets;
+	std::vector<unsigned int> mIndexOffsets;
+
+	std::vector<float> mPositions;
+	std::vector<float> mNormals;
+	std::vector<float> mUVs;
+	std::vector<unsigned int> mIndices;
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include "HairSolver.h"
+
+// CPUs of each NUMA node. Falls back to a single node with all hardware
+// threads where the OS does not report a topology.
+struct HairNumaTopology {
+	std::vector<std::vector<int> > nodeCpus;
+
+	static HairNumaTopology detect();
+	unsigned int numNodes() const { return (unsigned int)nodeCpus.size(); }
+};
+
+// Fixed strand-to-thread assignment for big grooms on multi-socket machines.
+// Threads are spread over the nodes in proportion to their CPU counts and
+// each gets a contiguous strand range of about equal point count, so every
+// node owns one contiguous slice of the DoF arrays. place() re-allocates the
+// arrays and lets each pinned thread first-touch its own range, which puts
+// the pages on the owner's node; step() then runs every range on the same
+// pinned thread, step after step. If OpenMP grants fewer threads than
+// numThreads() (OMP_THREAD_LIMIT, nesting), each thread takes several ranges
+// in turn: results are the same, only the placement is off. Pinning is done
+// on Windows and Linux only.
+class HairNumaPlacement {
+public:
+	HairNumaPlacement();
+
+	// numThreads 0 uses the OpenMP default.
+	void build(HairDoF &dof, int numThreads = 0);
+	// Moves the DoF, previous DoF and point type arrays to their owners' nodes.
+	// Arrays aliasing external memory are left where they are. The calling
+	// thread is OpenMP thread 0 and stays pinned afterwards.
+	void place(HairDoF &dof) const;
+	void step(const HairModel &model, HairDoF &dof) const;
+
+	int numThreads() const { return (int)mThreadCpu.size(); }
+	int threadNode(int thread) const { return mThreadNode[thread]; }
+	int firstStrand(int thread) const { return mStrandBegin[thread]; }
+	int endStrand(int thread) const { return mStrandBegin[thread + 1]; }
+
+	HairNumaTopology mTopology;
+	// Pin each thread to one CPU of its node; off leaves scheduling to the OS.
+	bool mPinThreads;
+
+private:
+	void pinCurrentThread(int thread) const;
+
+	std::vector<int> mThreadCpu;
+	std::vector<int> mThreadNode;
+	std::vector<int> mStrandBegin;
+};
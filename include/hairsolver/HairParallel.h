@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+#include <cstring>
+#include <cstddef>
+
+// Fixed strand partitioning for the deterministic solver paths. Blocks depend
+// only on the strand count, never on the number of threads, and per-block
+// results are combined in block order, so reductions are bit-identical for
+// any OpenMP schedule.
+class HairParallel {
+public:
+	static const int StrandBlockSize = 256;
+
+	static int numBlocks(int nStrands) { return (nStrands + StrandBlockSize - 1) / StrandBlockSize; }
+	static int blockBegin(int block) { return block * StrandBlockSize; }
+	static int blockEnd(int block, int nStrands) {
+		int end = (block + 1) * StrandBlockSize;
+		return end < nStrands ? end : nStrands;
+	}
+
+	// memcpy split into blocks over the OpenMP threads, so large copies are
+	// not limited to the bandwidth of a single core.
+	static void copy(void *dst, const void *src, size_t bytes) {
+		const size_t blockBytes = 1 << 20;
+		int nBlocks = (int)((bytes + blockBytes - 1) / blockBytes);
+
+#pragma omp parallel for schedule(static)
+		for (int b = 0; b < nBlocks; b++) {
+			size_t begin = (size_t)b * blockBytes;
+			size_t size = begin + blockBytes < bytes ? blockBytes : bytes - begin;
+			std::memcpy((char *)dst + begin, (const char *)src + begin, size);
+		}
+	}
+
+	// In-place inclusive prefix sum: per-block sums, a serial scan over the
+	// block totals, then a parallel fix-up pass.
+	static void inclusiveScan(unsigned int *values, int n) {
+		const int blockSize = 1 << 16;
+		int nBlocks = (n + blockSize - 1) / blockSize;
+		std::vector<unsigned int> blockBase(nBlocks + 1, 0);
+
+#pragma omp parallel for schedule(static)
+		for (int b = 0; b < nBlocks; b++) {
+			int end = (b + 1) * blockSize < n ? (b + 1) * blockSize : n;
+			for (int i = b * blockSize + 1; i < end; i++) values[i] += values[i - 1];
+			blockBase[b + 1] = values[end - 1];
+		}
+		for (int b = 0; b < nBlocks; b++) blockBase[b + 1] += blockBase[b];
+
+#pragma omp parallel for schedule(static)
+		for (int b = 1; b < nBlocks; b++) {
+			int end = (b + 1) * blockSize < n ? (b + 1) * blockSize : n;
+			for (int i = b * blockSize; i < end; i++) values[i] += blockBase[b];
+		}
+	}
+
+	// blockOp(firstStrand, endStrand) -> T, combine(T, T) -> T
+	template <typename T, typename BlockOp, typename Combine>
+	static T orderedReduce(int nStrands, T init, BlockOp blockOp, Combine combine) {
+		int nBlocks = numBlocks(nStrands);
+		std::vector<T> partial(nBlocks, init);
+
+#pragma omp parallel for schedule(static)
+		for (int b = 0; b < nBlocks; b++) partial[b] = blockOp(blockBegin(b), blockEnd(b, nStrands));
+
+		T result = init;
+		for (int b = 0; b < nBlocks; b++) result = combine(result, partial[b]);
+		return result;
+	}
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+
+// Counter-based random numbers (Philox4x32-10). A draw is a pure function of
+// (key, counter), so the values never depend on call order, thread count or
+// the platform's rand()/RAND_MAX.
+class HairRandom {
+public:
+	// Sequential draws for one independent stream (e.g. one strand).
+	class Stream {
+	public:
+		Stream(const HairRandom &rng, uint32_t streamId) : mRng(rng), mStreamId(streamId), mBlock(0), mUsed(4) {}
+
+		uint32_t next() {
+			if (mUsed == 4) {
+				mRng.generate(mStreamId, mBlock++, 0, 0, mWords);
+				mUsed = 0;
+			}
+			return mWords[mUsed++];
+		}
+
+		// Uniform in [0, 1).
+		float uniform() { return toUnitFloat(next()); }
+		float uniform(float lo, float hi) { return lo + (hi - lo) * uniform(); }
+
+	private:
+		const HairRandom &mRng;
+		uint32_t mStreamId;
+		uint32_t mBlock;
+		uint32_t mUsed;
+		uint32_t mWords[4];
+	};
+
+	explicit HairRandom(uint64_t seed) : mKey0((uint32_t)seed), mKey1((uint32_t)(seed >> 32)) {}
+
+	Stream stream(uint32_t streamId) const { return Stream(*this, streamId); }
+
+	void generate(uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3, uint32_t out[4]) const {
+		uint32_t k0 = mKey0, k1 = mKey1;
+		for (int round = 0; round < 10; round++) {
+			uint64_t p0 = (uint64_t)0xD2511F53u * c0;
+			uint64_t p1 = (uint64_t)0xCD9E8D57u * c2;
+			uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+			uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+			c0 = n0; c1 = (uint32_t)p1;
+			c2 = n2; c3 = (uint32_t)p0;
+			k0 += 0x9E3779B9u;
+			k1 += 0xBB67AE85u;
+		}
+		out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+	}
+
+	static float toUnitFloat(uint32_t x) { return (float)(x >> 8) * (1.0f / 16777216.0f); }
+
+private:
+	uint32_t mKey0, mKey1;
+};
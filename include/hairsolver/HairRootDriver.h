@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <Eigen/StdVector>
+#include "HairSolver.h"
+#include "HairScalp.h"
+#include "HairArena.h"
+
+// Drives strand roots from an animated character. Roots are bound either to
+// skeleton bones (up to four influences, linear blend or dual quaternion
+// skinning) or to triangles of a deforming scalp mesh. evaluate*() updates
+// every root position, and for HairDoF_PointsAndQuaternions the root frame,
+// in one parallel pass directly in the DoF array, replacing the
+// updateRoots/copyRootsToHair round trip.
+//
+// Bindings are stored one array per coordinate. Bone roots are evaluated in
+// blocks: the influences are gathered per root, the normalization, rotation
+// and frame arithmetic of the block vectorizes, and the roots are scattered
+// into the DoF array last, their cache lines prefetched a block ahead. Both
+// modes stay bound by that scatter, one or two cache lines per strand.
+class HairRootDriver {
+public:
+	enum Method { LinearBlend, DualQuaternion };
+
+	typedef std::vector<Eigen::Affine3f, Eigen::aligned_allocator<Eigen::Affine3f> > BoneTransforms;
+	typedef std::vector<Eigen::Vector4i, Eigen::aligned_allocator<Eigen::Vector4i> > BoneIndices;
+	typedef std::vector<Eigen::Vector4f, Eigen::aligned_allocator<Eigen::Vector4f> > BoneWeights;
+
+	HairRootDriver();
+
+	// The current root positions and frames of hair are the bind pose. Bone
+	// transforms passed to evaluateBones() map bind pose to posed space and
+	// must cover every bound bone; unused influences have weight 0 or a
+	// negative index.
+	bool bindToBones(HairDoF &hair, const BoneIndices &boneIndices, const BoneWeights &boneWeights);
+	// restScalp is the mesh in the bind pose; binding is one entry per strand.
+	bool bindToMesh(HairDoF &hair, const HairScalp &restScalp, const HairRootBinding &binding);
+
+	void evaluateBones(const BoneTransforms &bones, HairDoF &hair) const;
+	// deformedVertices has the vertex order of the rest scalp.
+	void evaluateMesh(const std::vector<Eigen::Vector3f> &deformedVertices, HairDoF &hair) const;
+
+	unsigned int numRoots() const { return (unsigned int)mRestPositions.rows(); }
+
+	Method mMethod;
+
+private:
+	typedef std::vector<Eigen::Quaternionf, Eigen::aligned_allocator<Eigen::Quaternionf> > Quaternions;
+
+	bool bindRoots(HairDoF &hair, size_t numBindings);
+
+	// Bind pose root positions (offsets from the bound surface point in mesh
+	// mode) and frames as x, y, z(, w) columns.
+	Eigen::MatrixX3f mRestPositions;
+	Eigen::MatrixX4f mRestFrames;
+
+	// Bone influences without the unused ones, slot by slot: influence k of
+	// root i is at k * numRoots() + i. Roots with fewer than mMaxInfluences
+	// pad with weight 0 on their first bone (bone 0 if they have none).
+	bool mBoundToBones;
+	int mMaxInfluences;
+	int mMaxBone;
+	std::vector<int> mInfluenceBones;
+	std::vector<float> mInfluenceWeights;
+
+	std::vector<Eigen::Vector3i> mTriangles;
+	std::vector<unsigned int> mRootTriangles;
+	std::vector<Eigen::Vector2f> mBarycentrics;
+	// Inverse of each rest triangle's tangent frame.
+	Quaternions mRestTriangleFrames;
+
+	// Per-bone and per-triangle transforms of one evaluation.
+	mutable HairArena mScratch;
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vector>
+#include <Eigen/Core>
+
+// Triangle mesh that hair is grown from. density is an optional per-vertex
+// density map (empty means uniform).
+class HairScalp {
+public:
+	std::vector<Eigen::Vector3f> vertices;
+	std::vector<Eigen::Vector3i> triangles;
+	std::vector<float> density;
+
+	Eigen::Vector3f position(unsigned int triangle, const Eigen::Vector2f &barycentric) const;
+	// Interpolated, area-weighted vertex normal.
+	Eigen::Vector3f normal(unsigned int triangle, const Eigen::Vector2f &barycentric) const;
+
+	// Recomputes the vertex normals; call after editing vertices or triangles.
+	void update();
+
+private:
+	std::vector<Eigen::Vector3f> mVertexNormals;
+};
+
+// Where each strand root sits on the scalp: triangle id and barycentric
+// coordinates (u, v) with weights (1 - u - v, u, v) on the triangle vertices.
+class HairRootBinding {
+public:
+	std::vector<unsigned int> triangles;
+	std::vector<Eigen::Vector2f> barycentrics;
+};
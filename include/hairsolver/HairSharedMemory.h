@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+// Named, read-write shared memory segment that local processes map by name
+// (POSIX shm_open, or a pagefile-backed file mapping on Windows). The
+// creator removes the name on close; mappings in other processes stay valid
+// until they close too.
+class HairSharedMemory {
+public:
+	HairSharedMemory();
+	~HairSharedMemory();
+
+	// Fails if a segment with this name already exists. Contents start zeroed.
+	bool create(const std::string &name, size_t size);
+	bool open(const std::string &name);
+	void close();
+
+	bool isOpen() const { return mData != nullptr; }
+	char *data() const { return mData; }
+	size_t size() const { return mSize; }
+	const std::string &name() const { return mName; }
+
+private:
+	HairSharedMemory(const HairSharedMemory &) = delete;
+	HairSharedMemory & operator= (const HairSharedMemory &) = delete;
+
+	char *mData;
+	size_t mSize;
+	std::string mName;
+	bool mOwner;
+#if defined(_WIN32)
+	void *mMapping;
+#endif
+};
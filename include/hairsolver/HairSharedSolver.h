@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "HairSolver.h"
+#include "HairSharedMemory.h"
+
+// Shared segment layout
+//
+//   HairSharedHeader                         solver parameters and barrier
+//   strandBegin  uint32[numWorkers + 1]      worker partitions
+//   topology     int32[numStrands + 1]       64-byte aligned
+//   types        int32[numPoints]            64-byte aligned
+//   dof          float[vertexSize * numPoints]
+//   dofPrev      float[vertexSize * numPoints]
+//   roots        float[vertexSize * numStrands], written by the coordinator
+struct HairSharedHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t numWorkers;
+	uint32_t numStrands;
+	uint32_t numPoints;
+	uint32_t vertexSize;
+	uint32_t modelType;
+
+	float timestep;
+	float gravity;
+	float segmentLength;
+	uint32_t stiffness;
+	float hairRadius;
+	float tolerance;
+	float relativeTolerance;
+	uint32_t minIterations;
+
+	uint64_t strandBeginOffset;
+	uint64_t topologyOffset;
+	uint64_t typesOffset;
+	uint64_t dofOffset;
+	uint64_t dofPrevOffset;
+	uint64_t rootsOffset;
+
+	// Barrier: the coordinator bumps stepRequested, each worker bumps
+	// stepsDone once per step; step k is done at numWorkers * k.
+	alignas(64) std::atomic<uint32_t> stepRequested;
+	alignas(64) std::atomic<uint32_t> stepsDone;
+	std::atomic<uint32_t> workersAttached;
+	std::atomic<uint32_t> stop;
+};
+
+// Simulates one groom with N local worker processes. The coordinator copies
+// the DoFs into a shared segment (and re-points the caller's HairDoF at it),
+// and launches workers that each step one contiguous strand partition in
+// place. Per step it computes the roots, publishes them in the segment and
+// waits on the barrier. Strands never interact, so results match a
+// single-process step.
+class HairSharedSolver {
+public:
+	enum ModelType { FollowTheLeader = 0, PBD_Cosserat = 1 };
+
+	HairSharedSolver();
+	~HairSharedSolver();
+
+	bool create(const std::string &name, HairDoF &dof, const HairModel &model, unsigned int numWorkers);
+	// Runs executable with arguments: workerFlag <segment name> <worker index>.
+	bool launchWorkers(const std::string &executable, const std::string &workerFlag = "--worker");
+	// Publishes the roots (one element per strand, as in copyRootsFromHair)
+	// and waits until all workers finished the step.
+	bool step(HairDoF &roots);
+	// Stops the workers and waits for them to exit.
+	void shutdown();
+
+	// Worker side: attaches to the segment and steps its partition until the
+	// coordinator stops. Returns the process exit code.
+	static int runWorker(const std::string &name, unsigned int index);
+
+	unsigned int numWorkers() const { return mHeader ? mHeader->numWorkers : 0; }
+
+private:
+	bool workersAlive();
+	void waitForWorkers();
+
+	std::shared_ptr<HairSharedMemory> mSegment;
+	HairSharedHeader *mHeader;
+	uint32_t mStep;
+	std::vector<intptr_t> mWorkers;
+};
@@ -1,37 +1,78 @@
 #pragma once
 
 #include <Eigen/Core>
-#include <Eigen\Geometry>
+#include <Eigen/Geometry>
 #include "HairGeo.h"
+#include "HairDoFArray.h"
+#include "HairArena.h"
 
 class HairDoF {
 public:
+	typedef HairDoFArray<float> DoFArray;
+	typedef HairDoFArray<int> IndexArray;
+
 	HairDoF();
+	virtual ~HairDoF() {}
 
 	void rotateFromPrev(Eigen::Quaternionf &rot);
 	void copyRootsFromHair(HairDoF &src);
 	void copyRootsToHair(HairDoF &dst);
 
 	virtual unsigned int vertexSize() const = 0;
-	virtual void advance(float timestep, float gravity) = 0;
-	virtual void extraInitialize() {};
+	// Integrates all points, in parallel blocks of AdvanceBlockSize points.
+	void advance(float timestep, float gravity);
+	// Integrates points [firstPoint, endPoint) on the calling thread.
+	virtual void advance(float timestep, float gravity, int firstPoint, int endPoint) = 0;
+	// Derives the DoFs beyond the points (e.g. material frames) from the points.
+	void extraInitialize();
+	virtual void extraInitialize(int, int) {};
 
 
 	HairDoF & operator= (const HairGeo&o);
+	// Resizes all arrays for the given strand offsets and sets the point types.
+	void setTopology(const unsigned int *offsets, unsigned int numStrands);
+	// Initializes from raw groom arrays (e.g. a mapped HairGroomFile), copying points in parallel.
+	void assign(const unsigned int *offsets, unsigned int numStrands, const Eigen::Vector3f *points);
+	// Takes the groom storage instead of copying it: with vertexSize() == 3 the
+	// DoFs and topology alias the moved points and offsets, other layouts fall
+	// back to assign(). o is left empty either way.
+	HairDoF & adopt(HairGeo &&o);
+
+	// Incremental topology edits. resizeStrands() keeps the state of the
+	// strands that groom shares with the DoFs (same point counts), drops the
+	// strands past groom.numStrands() and appends the rest of groom at rest,
+	// turned by rotation. Storage grows geometrically, so only the new strands
+	// are written. False (and unchanged) if a kept strand changed its size.
+	bool resizeStrands(const HairGeo &groom, const Eigen::Quaternionf &rotation = Eigen::Quaternionf::Identity());
+	// Resamples current and previous points of every strand along their
+	// shape (see HairGeo::resampleStrand), keeping positions and velocities.
+	void resample(unsigned int pointsPerStrand, float spacing = 0);
+	// For roots (see copyRootsFromHair): keeps the existing roots and takes
+	// the new ones from hair, whose new strands were turned by rotation.
+	void resizeRootsFromHair(HairDoF &hair, const Eigen::Quaternionf &rotation = Eigen::Quaternionf::Identity());
 	
-	Eigen::VectorXf &getDoFs() { return mDof; }
-	Eigen::VectorXf &getPrevDoFs() { return mDofPrev; }
-	Eigen::VectorXi &getTopology() { return mTopology; }
-	Eigen::VectorXi &getPointType() { return mPointType; }
+	DoFArray &getDoFs() { return mDof; }
+	DoFArray &getPrevDoFs() { return mDofPrev; }
+	IndexArray &getTopology() { return mTopology; }
+	IndexArray &getPointType() { return mPointType; }
+
+	// Hash of the DoF bits, reduced over fixed strand blocks in order. Equal
+	// hashes mean bit-identical states, independently of the thread count.
+	unsigned long long stateHash();
 
 	float mHairRadius;
 
+	static const int AdvanceBlockSize = 4096;
+
 private:
-	Eigen::VectorXf mDof;
-	Eigen::VectorXf mDofPrev;
+	void initPointTypes();
+	void initPointTypes(int firstStrand, int endStrand);
 
-	Eigen::VectorXi mTopology;
-	Eigen::VectorXi mPointType;
+	DoFArray mDof;
+	DoFArray mDofPrev;
+
+	IndexArray mTopology;
+	IndexArray mPointType;
 };
 
 class HairDoF_Points : public HairDoF {
@@ -40,7 +81,8 @@ public:
 	HairDoF_Points & operator= (const HairGeo&o);
 
 	unsigned int vertexSize() const;
-	void advance(float timestep, float gravity);
+	using HairDoF::advance;
+	void advance(float timestep, float gravity, int firstPoint, int endPoint);
 };
 
 class HairDoF_PointsAndQuaternions : public HairDoF {
@@ -49,8 +91,10 @@ public:
 	HairDoF_PointsAndQuaternions & operator= (const HairGeo&o);
 
 	unsigned int vertexSize() const;
-	void advance(float timestep, float gravity);
-	void extraInitialize() override;
+	using HairDoF::advance;
+	void advance(float timestep, float gravity, int firstPoint, int endPoint);
+	using HairDoF::extraInitialize;
+	void extraInitialize(int firstStrand, int endStrand) override;
 };
 
 
@@ -58,10 +102,16 @@ class HairModel {
 public:
 
 	HairModel();
+	virtual ~HairModel() {}
 	void updateRoots(HairDoF &roots);
 	void step(HairDoF &dof) const;
+	// Steps strands [firstStrand, endStrand) on the calling thread, for
+	// schedulers that split the work themselves (see HairWorld). Strands are
+	// independent, so any partition gives the same result as step().
+	void stepStrands(HairDoF &dof, int firstStrand, int endStrand) const;
 	void reset();
 	virtual void solve(HairDoF &dof) const = 0;
+	virtual void solveStrands(HairDoF &dof, int firstStrand, int endStrand) const = 0;
 
 	float mTimestep;
 	float mGravity;
@@ -77,7 +127,17 @@ public:
 
 	float mCurrentTime;
 	bool mTransform;
+
+	// Deterministic mode: solvers walk fixed strand blocks (see HairParallel)
+	// and keep every per-strand update in a fixed order, so the output is
+	// bit-identical across thread counts. Requires precise floating point
+	// (no fast-math / FMA contraction) to also hold across machines.
+	bool mDeterministic;
 	Eigen::Quaternionf mRootRotation, mCurrentRootRotation;
+
+	// Scratch for the stages of one step, reset by step(). Stepping is
+	// checked with HairHeapGuard in HAIR_HEAP_GUARD builds.
+	mutable HairArena mArena;
 };
 
 class HairModel_FollowTheLeader : public HairModel {
@@ -86,6 +146,41 @@ public:
 	HairModel_FollowTheLeader();
 
 	void solve(HairDoF &dof) const;
+	void solveStrands(HairDoF &dof, int firstStrand, int endStrand) const;
+};
+
+// Largest constraint errors met by a solver pass, before its corrections:
+// stretch-shear strain |(B - A) / l - d3| and bend-twist |vec(conj(qA) qB)|.
+struct HairResidual {
+	float stretchShear;
+	float bendTwist;
+
+	HairResidual() : stretchShear(0), bendTwist(0) {}
+	void add(const HairResidual &o) {
+		if (o.stretchShear > stretchShear) stretchShear = o.stretchShear;
+		if (o.bendTwist > bendTwist) bendTwist = o.bendTwist;
+	}
+};
+
+struct HairStrandSolve {
+	unsigned int iterations;
+	bool converged;
+	// Residual of the last iteration.
+	HairResidual residual;
+};
+
+struct HairSolverStats {
+	unsigned int strands;
+	unsigned long long iterations;
+	unsigned int maxIterations;
+	// Strands that met a tolerance before running out of iterations.
+	unsigned int converged;
+	HairResidual residual;
+	// Per strand; lives in the model arena until the next step.
+	const HairStrandSolve *strandSolves;
+
+	HairSolverStats() : strands(0), iterations(0), maxIterations(0), converged(0), strandSolves(nullptr) {}
+	float meanIterations() const { return strands > 0 ? (float)iterations / strands : 0; }
 };
 
 class HairModel_PBD_Cosserat : public HairModel {
@@ -93,5 +188,29 @@ public:
 	HairModel_PBD_Cosserat();
 
 	void solve(HairDoF &dof) const;
-	void solveStrand(HairDoF &dof, unsigned int i, float pointDisplacementScale, float quaternionDisplacementScale, float twistBendFactor) const;
+	void solveStrands(HairDoF &dof, int firstStrand, int endStrand) const;
+	void solveDeterministic(HairDoF &dof, float pointDisplacementScale, float quaternionDisplacementScale, float twistBendFactor) const;
+	void solveAdaptive(HairDoF &dof, float pointDisplacementScale, float quaternionDisplacementScale, float twistBendFactor) const;
+	// With strandSolves, writes the iterations and residual of strand i to strandSolves[i - firstStrand].
+	void solveStrandRange(HairDoF &dof, int firstStrand, int endStrand, float pointDisplacementScale, float quaternionDisplacementScale, float twistBendFactor, HairStrandSolve *strandSolves = nullptr) const;
+	void solverScales(const HairDoF &dof, float &pointDisplacementScale, float &quaternionDisplacementScale, float &twistBendFactor) const;
+	// Raises residual to the errors met at point i, if given.
+	void solveStrand(HairDoF &dof, unsigned int i, float pointDisplacementScale, float quaternionDisplacementScale, float twistBendFactor, HairResidual *residual = nullptr) const;
+	bool isAdaptive() const { return mTolerance > 0 || mRelativeTolerance > 0; }
+	// initial is the residual of the strand's first iteration in this step.
+	bool isConverged(const HairResidual &residual, const HairResidual &initial, unsigned int iteration) const;
+
+	// Adaptive iterations, off when both tolerances are 0: each strand stops
+	// once both residuals of an iteration are met, each either within
+	// mTolerance or down to mRelativeTolerance times its value in the
+	// strand's first iteration of the step (the bend-twist error settles
+	// above zero, so the two are meant to be combined). Strands run at least
+	// mMinIterations and at most mStiffness iterations, and converge
+	// independently, so results do not depend on the thread count.
+	float mTolerance;
+	float mRelativeTolerance;
+	unsigned int mMinIterations;
+	// Iterations and residuals of the last solve() (strand-range stepping
+	// does not update them).
+	mutable HairSolverStats mStats;
 };
\ No newline at end of file
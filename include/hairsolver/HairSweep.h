@@ -0,0 +1,61 @@
+#pragma once
+
+#include <ostream>
+#include <vector>
+#include "HairGeo.h"
+#include "HairSolver.h"
+
+// Parameter sweep: simulates one groom under many solver settings at once
+// and tabulates how each run behaved. Runs share the groom topology and
+// point types (aliased, read-only); only their DoFs are private. A batch of
+// runs is stepped together by a HairWorld, which packs the small runs into
+// tasks, so throughput does not depend on the size of a single run.
+class HairSweep {
+public:
+	struct Params {
+		float timestep;
+		float segmentLength;
+		unsigned int stiffness;
+		float hairRadius;
+	};
+
+	struct Result {
+		Params params;
+		// False once a point went non-finite or a segment error passed mUnstableError.
+		bool stable;
+		// Steps simulated; unstable runs stop at the check that caught them.
+		unsigned int steps;
+		// Relative segment length error |l - segmentLength| / segmentLength.
+		float maxError;
+		float meanError;
+		// Solver time per step, summed over threads.
+		double secondsPerStep;
+	};
+
+	HairSweep();
+
+	// Every combination of the given values.
+	void addGrid(const std::vector<float> &timesteps, const std::vector<float> &segmentLengths, const std::vector<unsigned int> &stiffnesses, const std::vector<float> &hairRadii);
+	// count runs, each parameter uniform in [lo, hi]. Run i draws only from
+	// the random stream (seed, i).
+	void addRandom(unsigned int count, const Params &lo, const Params &hi, unsigned int seed);
+
+	// Simulates every run for steps steps, starting from groom at rest with
+	// the run's segment length. Everything else (model type, gravity, root
+	// motion, determinism) is taken from prototype.
+	bool run(const HairGeo &groom, const HairModel &prototype, unsigned int steps);
+
+	// CSV, one row per run.
+	void writeTable(std::ostream &out) const;
+
+	std::vector<Params> mRuns;
+	std::vector<Result> mResults;
+
+	// Runs stepped together; 0 uses four per hardware thread.
+	unsigned int mBatchSize;
+	// Steps between stability checks; unstable runs are dropped from the batch.
+	unsigned int mCheckInterval;
+	float mUnstableError;
+	// Wall time of the last run().
+	double mSeconds;
+};
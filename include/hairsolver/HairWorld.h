@@ -0,0 +1,65 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "HairSolver.h"
+
+// Steps many grooms (each a DoF + model pair, optionally with driven roots)
+// on one OpenMP team. Every step the strands of all assets are cut into
+// tasks of roughly equal cost: small assets are packed into shared tasks,
+// large ones are split into strand ranges, so one big groom no longer keeps
+// the rest of the machine idle while the small ones wait.
+class HairWorld {
+public:
+	struct Asset {
+		std::string name;
+		std::shared_ptr<HairDoF> dof;
+		std::shared_ptr<HairModel> model;
+		// Optional; moved by model->updateRoots() and copied into dof every step.
+		std::shared_ptr<HairDoF> roots;
+		bool enabled;
+
+		// Solver time summed over all threads, for the last step and in total.
+		double stepSeconds;
+		double totalSeconds;
+	};
+
+	HairWorld();
+
+	// Takes ownership; dof must be initialized. With roots, they are copied
+	// from dof here. Returns the asset index.
+	unsigned int addAsset(const std::string &name, std::unique_ptr<HairDoF> dof, std::unique_ptr<HairModel> model, std::unique_ptr<HairDoF> roots = nullptr);
+	// Steps objects owned elsewhere, which must outlive the asset (or the
+	// next clear()). Roots are used as they are, not copied from dof.
+	unsigned int addAsset(const std::string &name, HairDoF &dof, HairModel &model, HairDoF *roots = nullptr);
+	void clear();
+
+	unsigned int numAssets() const { return (unsigned int)mAssets.size(); }
+	Asset &asset(unsigned int i) { return mAssets[i]; }
+
+	void step();
+	void printTimings() const;
+
+	// Wall time of the last step.
+	double mStepSeconds;
+	// Lower bound on task cost (points times solver passes), so tiny tasks
+	// do not drown in scheduling overhead.
+	unsigned int mMinTaskCost;
+
+private:
+	struct Range {
+		unsigned int asset;
+		int firstStrand;
+		int endStrand;
+	};
+
+	void schedule();
+
+	std::vector<Asset> mAssets;
+	std::vector<Range> mRanges;
+	// Ranges [mTasks[t], mTasks[t + 1]) form task t.
+	std::vector<int> mTasks;
+	std::vector<double> mRangeSeconds;
+	HairArena mScratch;
+};
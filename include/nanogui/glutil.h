@@ -78,8 +78,29 @@ public:
         GLuint compSize;///< The size (in bytes) of an individual element in this buffer.
         GLuint size;    ///< The total number of elements represented by this buffer.
         int version;    ///< The current version if this buffer.
+        GLuint stride;  ///< Components from one vertex to the next (0: tightly packed).
+        GLuint offset;  ///< Byte offset of the current contents (streamed buffers).
     };
 
+    /**
+     * \brief How \ref GLShader::streamAttrib refreshes a buffer whose
+     * contents change every frame.
+     */
+    enum class StreamMode {
+        /// Re-specify the storage, then ``glBufferSubData``: the driver hands
+        /// out fresh memory while the GPU still reads the old contents.
+        Orphan,
+        /// ``glBufferSubData`` into the existing storage; may wait for the GPU.
+        SubData,
+        /// Copy into a persistently mapped ring of \ref StreamFrames frames,
+        /// each fenced until the GPU is done drawing it. Needs OpenGL 4.4 or
+        /// ``ARB_buffer_storage``, falls back to ``Orphan`` otherwise.
+        Persistent
+    };
+
+    /// Frames a persistently mapped stream keeps in flight.
+    static const int StreamFrames = 3;
+
     /// Create an unitialized OpenGL shader
     GLShader()
         : mVertexShader(0), mFragmentShader(0), mGeometryShader(0),
@@ -162,7 +183,30 @@ public:
                      glType, integral, M.data(), version);
     }
 
-    /// Download a vertex buffer object into an Eigen matrix
+    /**
+     * \brief Upload per-frame vertex data without reallocating or repacking it.
+     *
+     * Copies ``count`` vertices of ``dim`` components, ``stride`` components
+     * apart (e.g. the points of 7-float position and quaternion arrays),
+     * with one ``memcpy``; the attribute reads them with that stride. The
+     * storage is kept across frames and only grows.
+     */
+    template <typename T> void streamAttrib(const std::string &name, const T *data, size_t count,
+                                            int dim, int stride = 0, StreamMode mode = StreamMode::Persistent) {
+        uint32_t compSize = sizeof(T);
+        GLuint glType = (GLuint) detail::type_traits<T>::type;
+        bool integral = (bool) detail::type_traits<T>::integral;
+
+        streamAttrib(name, count, dim, stride, compSize, glType, integral, data, mode);
+    }
+
+    /**
+     * \brief Download a vertex buffer object into an Eigen matrix with one
+     * column per vertex.
+     *
+     * Attributes streamed with a stride are de-interleaved: only the ``dim``
+     * components of each vertex are returned.
+     */
     template <typename Matrix> void downloadAttrib(const std::string &name, Matrix &M) {
         uint32_t compSize = sizeof(typename Matrix::Scalar);
         GLuint glType = (GLuint) detail::type_traits<typename Matrix::Scalar>::type;
@@ -172,7 +216,8 @@ public:
             throw std::runtime_error("downloadAttrib(" + mName + ", " + name + ") : buffer not found!");
 
         const Buffer &buf = it->second;
-        M.resize(buf.dim, buf.size / buf.dim);
+        GLuint stride = buf.stride > buf.dim ? buf.stride : buf.dim;
+        M.resize(buf.dim, buf.size == 0 ? 0 : (buf.size - buf.dim) / stride + 1);
 
         downloadAttrib(name, M.size(), M.rows(), compSize, glType, M.data());
     }
@@ -353,8 +398,26 @@ public:
                        const void *data, int version = -1);
     void downloadAttrib(const std::string &name, size_t size, int dim,
                        uint32_t compSize, GLuint glType, void *data);
+    void streamAttrib(const std::string &name, size_t count, int dim, int stride,
+                      uint32_t compSize, GLuint glType, bool integral,
+                      const void *data, StreamMode mode);
 
 protected:
+    /// Storage of an attribute uploaded with \ref streamAttrib.
+    struct Stream {
+        StreamMode mode;
+        size_t capacity;            ///< Bytes of one frame.
+        int frame;                  ///< Ring frame holding the current contents.
+        void *mapped;               ///< Persistent mapping of all frames.
+        GLsync fences[StreamFrames];///< Set after the draws that read a frame.
+    };
+
+    /// Release the storage and fences of a streamed attribute
+    void freeStream(const std::string &name);
+
+    /// Fence the current frame of all persistently mapped streams
+    void fenceStreams();
+
     /// The registered name of this GLShader.
     std::string mName;
 
@@ -379,6 +442,9 @@ protected:
      */
     std::map<std::string, Buffer> mBufferObjects;
 
+    /// The attributes uploaded with \ref streamAttrib, by name.
+    std::map<std::string, Stream> mStreams;
+
     /**
      * \rst
      * The map of preprocessor names to values (if any have been created).  If
@@ -17,6 +17,7 @@
 #include <unordered_map>
 #include <fstream>
 #include <memory>
+#include <new>
 #include <set>
 
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
@@ -52,6 +53,13 @@ NAMESPACE_END(detail)
  * Note that this header file just provides the basics; the files
  * ``nanogui/serializer/opengl.h``, and ``nanogui/serializer/sparse.h`` must
  * be included to serialize the respective data types.
+ *
+ * Files opened for reading with ``mapped=true`` are memory mapped instead
+ * of read through a stream: fields are copied straight out of the mapping,
+ * and large dense matrices can be accessed in place using \ref getMap().
+ *
+ * Writes are buffered and reach the file in aligned chunks. With \ref
+ * setCompression(), dense matrices are additionally stored compressed.
  */
 class Serializer {
 protected:
@@ -61,10 +69,24 @@ protected:
 #endif
 
 public:
-    /// Create a new serialized file for reading or writing
-    Serializer(const std::string &filename, bool write);
+    /**
+     * \brief Create a new serialized file for reading or writing
+     *
+     * When \c mapped is set, a file opened for reading is memory mapped
+     * (see \ref getMap()).
+     */
+    Serializer(const std::string &filename, bool write, bool mapped = false);
 
-    /// Release all resources
+    /**
+     * \brief Finish the file and release all resources
+     *
+     * A file opened for writing receives its table of contents here, so
+     * call this to learn whether it was written completely: I/O errors
+     * throw a \c std::runtime_error. Further calls do nothing.
+     */
+    void close();
+
+    /// Calls \ref close(); errors are reported on \c std::cerr, not thrown
     ~Serializer();
 
     /// Check whether a file contains serialized data
@@ -96,6 +118,23 @@ public:
     /// Return whether compatibility mode is enabled
     bool compatibility() { return mCompatibility; }
 
+    /// Return whether the file is memory mapped
+    bool mapped() const { return mMapping != nullptr; }
+
+    /**
+     * \brief Enable/disable compression of dense matrices
+     *
+     * When enabled, the dense matrix fields stored afterwards are split into
+     * chunks that are byte-shuffled and LZ-compressed (chunks that do not
+     * shrink are kept as they are). Files with compressed fields carry the
+     * codec of each field in their table of contents and are marked
+     * ``SER_V2``, which older versions of this class refuse to open.
+     */
+    void setCompression(bool compression) { mCompression = compression; }
+
+    /// Return whether compression is enabled
+    bool compression() const { return mCompression; }
+
     /// Store a field in the serialized file (when opened with ``write=true``)
     template <typename T> void set(const std::string &name, const T &value) {
         typedef detail::serialization_helper<T> helper;
@@ -119,6 +158,36 @@ public:
             pop();
         return true;
     }
+
+    /**
+     * \brief Point a map at a dense matrix field without copying it (when
+     * opened with ``mapped=true``)
+     *
+     * The matrix is read in place from the file mapping, so the map stays
+     * valid until the serializer is closed or destroyed. Uncompressed
+     * matrices are padded in the file so that their data starts at a
+     * multiple of 16 bytes; a misaligned one (only possible in files written
+     * before the padding) is copied into memory owned by the serializer
+     * instead. The same holds for compressed matrices and for files opened
+     * without a mapping, whose copies are aligned for \c Scalar only, hence
+     * \c value must be an unaligned map (the default).
+     */
+    template <typename Matrix> bool getMap(const std::string &name, Eigen::Map<const Matrix> &value) {
+        typedef typename Matrix::Scalar Scalar;
+        if (!get_base(name, detail::serialization_helper<Matrix>::type_id()))
+            return false;
+        uint32_t rows = 0, cols = 0;
+        read(&rows, sizeof(uint32_t));
+        read(&cols, sizeof(uint32_t));
+        if ((Matrix::RowsAtCompileTime != Eigen::Dynamic && rows != (uint32_t) Matrix::RowsAtCompileTime) ||
+            (Matrix::ColsAtCompileTime != Eigen::Dynamic && cols != (uint32_t) Matrix::ColsAtCompileTime))
+            throw std::runtime_error("\"" + mFilename + "\": field named \"" + mKey +
+                                     "\" has an incompatible size!");
+        const Scalar *data = (const Scalar *) mapArray(sizeof(Scalar), (size_t) rows * (size_t) cols, alignof(Scalar));
+        /* Maps cannot be reassigned, only constructed again in place */
+        new (&value) Eigen::Map<const Matrix>(data, rows, cols);
+        return true;
+    }
 protected:
     void set_base(const std::string &name, const std::string &type_id);
     bool get_base(const std::string &name, const std::string &type_id);
@@ -129,12 +198,42 @@ protected:
     void read(void *p, size_t size);
     void write(const void *p, size_t size);
     void seek(size_t pos);
+    /// Return the next \c size bytes of a mapped file and skip over them
+    const void *map(size_t size);
+
+    /// Write/read \c count elements of \c elementSize bytes with the codec of the current field
+    void writeArray(const void *p, size_t elementSize, size_t count);
+    void readArray(void *p, size_t elementSize, size_t count);
+    /// Return \c count elements in place, or an owned copy if they are not \c alignment aligned (see \ref getMap())
+    const void *mapArray(size_t elementSize, size_t count, size_t alignment);
+
+    /// Write buffered data to the file
+    void flush();
 private:
+    /// Type id, offset and codec of a field
+    struct Record {
+        std::string type_id;
+        uint64_t offset;
+        uint8_t codec;
+    };
+
     std::string mFilename;
-    bool mWrite, mCompatibility;
+    bool mWrite, mCompatibility, mCompression = false, mClosed = false;
     std::fstream mFile;
-    std::unordered_map<std::string, std::pair<std::string, uint64_t>> mTOC;
+    std::unordered_map<std::string, Record> mTOC;
     std::vector<std::string> mPrefixStack;
+    /// Scratch for the full name of a field, reused by every lookup
+    std::string mKey;
+    /// Codec of the field being read or written
+    uint8_t mCodec = 0;
+    const uint8_t *mMapping = nullptr;
+    size_t mMappingSize = 0, mPosition = 0;
+    /// Pending output, which starts at file offset \c mWritten
+    std::vector<uint8_t> mBuffer;
+    uint64_t mWritten = 0;
+    /// Chunk scratch of the codec, and matrices decompressed by getMap()
+    std::vector<uint8_t> mScratch;
+    std::vector<std::unique_ptr<uint8_t[]>> mDecoded;
 };
 
 NAMESPACE_BEGIN(detail)
@@ -306,7 +405,7 @@ struct serialization_helper<Eigen::Matrix<Scalar, Rows, Cols, Options, MaxRows,
             uint32_t rows = value->rows(), cols = value->cols();
             s.write(&rows, sizeof(uint32_t));
             s.write(&cols, sizeof(uint32_t));
-            serialization_helper<Scalar>::write(s, value->data(), rows*cols);
+            s.writeArray(value->data(), sizeof(Scalar), (size_t) rows * cols);
             value++;
         }
     }
@@ -317,7 +416,7 @@ struct serialization_helper<Eigen::Matrix<Scalar, Rows, Cols, Options, MaxRows,
             s.read(&rows, sizeof(uint32_t));
             s.read(&cols, sizeof(uint32_t));
             value->resize(rows, cols);
-            serialization_helper<Scalar>::read(s, value->data(), rows*cols);
+            s.readArray(value->data(), sizeof(Scalar), (size_t) rows * cols);
             value++;
         }
     }
@@ -14,6 +14,7 @@
 
 #include <nanogui/serializer/core.h>
 #include <nanogui/glutil.h>
+#include <algorithm>
 #include <set>
 
 NAMESPACE_BEGIN(nanogui)
@@ -41,15 +42,16 @@ struct serialization_helper<GLShader> {
                 s.set("dim", buf.dim);
                 s.set("size", buf.size);
                 s.set("version", buf.version);
+                s.set("stride", buf.stride);
                 Eigen::Matrix<uint8_t, Eigen::Dynamic, Eigen::Dynamic> temp(1, totalSize);
 
                 if (item.first == "indices") {
                     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buf.id);
-                    glGetBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, totalSize,
+                    glGetBufferSubData(GL_ELEMENT_ARRAY_BUFFER, buf.offset, totalSize,
                                        temp.data());
                 } else {
                     glBindBuffer(GL_ARRAY_BUFFER, buf.id);
-                    glGetBufferSubData(GL_ARRAY_BUFFER, 0, totalSize, temp.data());
+                    glGetBufferSubData(GL_ARRAY_BUFFER, buf.offset, totalSize, temp.data());
                 }
                 s.set("data", temp);
                 s.pop();
@@ -74,6 +76,9 @@ struct serialization_helper<GLShader> {
             }
             value->bind();
             for (auto key : keys) {
+                /* Streamed storage may be immutable */
+                if (value->mStreams.find(key) != value->mStreams.end())
+                    value->freeAttrib(key);
                 if (value->mBufferObjects.find(key) == value->mBufferObjects.end()) {
                     GLuint bufferID;
                     glGenBuffers(1, &bufferID);
@@ -88,6 +93,11 @@ struct serialization_helper<GLShader> {
                 s.get("dim", buf.dim);
                 s.get("size", buf.size);
                 s.get("version", buf.version);
+                /* Files written before streamed attributes have no stride */
+                buf.stride = 0;
+                buf.offset = 0;
+                if (std::find(all_keys.begin(), all_keys.end(), key + ".stride") != all_keys.end())
+                    s.get("stride", buf.stride);
                 s.get("data", data);
                 s.pop();
 
@@ -103,7 +113,8 @@ struct serialization_helper<GLShader> {
                     glBufferData(GL_ARRAY_BUFFER, totalSize, (void *) data.data(),
                                  GL_DYNAMIC_DRAW);
                     glVertexAttribPointer(attribID, buf.dim, buf.glType,
-                                          buf.compSize == 1 ? GL_TRUE : GL_FALSE, 0, 0);
+                                          buf.compSize == 1 ? GL_TRUE : GL_FALSE,
+                                          (GLsizei) (buf.stride * buf.compSize), 0);
                 }
             }
             if (count > 1)
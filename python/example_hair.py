@@ -0,0 +1,79 @@
+# python/example_hair.py -- Python version of the stepping loop of the hair
+# benchmark: grows a radial groom, steps it with nanogui.hair.stepMany and
+# records frames into NumPy arrays. For a C++ implementation, see
+# '../src/hairsim.cpp'.
+#
+# The asserts double as a smoke test of the bindings: DoF arrays are views of
+# the solver storage, and recorded frames keep the shape they were given.
+
+import time
+
+import numpy as np
+from nanogui import hair
+
+numHairs = 1000
+pointsPerHair = 16
+
+model = hair.HairModel_PBD_Cosserat()
+model.rotYfreq = 1.0
+model.rotYamp = 0.1
+
+dofs = hair.HairDoF_PointsAndQuaternions()
+dofs.adopt(hair.HairCreator.createRadialHair(0, numHairs, pointsPerHair,
+                                             (pointsPerHair - 1) * model.segmentLength))
+roots = hair.HairDoF_PointsAndQuaternions()
+roots.copyRootsFromHair(dofs)
+numPoints = dofs.numPoints()
+
+# getDoFs() aliases the solver storage: two views share memory, writes through
+# a view reach the solver, and the solver's writes show up in old views
+view = dofs.getDoFs()
+assert view.shape == (numPoints, dofs.vertexSize())
+assert view.dtype == np.float32 and view.flags.writeable
+assert np.shares_memory(view, dofs.getDoFs())
+
+before = dofs.stateHash()
+view[1, 0] = 5.0
+assert dofs.getDoFs()[1, 0] == 5.0 and dofs.stateHash() != before
+hair.stepMany(model, dofs, 1)
+assert np.array_equal(view, dofs.getDoFs())
+
+# Positions (3 columns) or whole DoFs (vertexSize columns) after every
+# interval steps, written into arrays allocated once
+steps = 20
+interval = 5
+positions = np.zeros((steps // interval, numPoints, 3), dtype=np.float32)
+hair.stepMany(model, dofs, steps, roots, positions, interval)
+assert positions.shape == (steps // interval, numPoints, 3)
+assert np.array_equal(positions[-1], view[:, :3])
+assert not np.array_equal(positions[0], positions[-1])
+
+# The same call by keyword, then the overload stepping several grooms together
+# on the solver thread pool: (model, dof[, roots]) tuples, one frames entry each
+hair.stepMany(model=model, dof=dofs, steps=steps, roots=roots, frames=positions, interval=interval)
+assert np.array_equal(positions[-1], view[:, :3])
+
+model2 = hair.HairModel_PBD_Cosserat()
+dofs2 = hair.HairDoF_PointsAndQuaternions()
+dofs2.adopt(hair.HairCreator.createRadialHair(1, numHairs // 2, pointsPerHair,
+                                              (pointsPerHair - 1) * model2.segmentLength))
+roots2 = hair.HairDoF_PointsAndQuaternions()
+roots2.copyRootsFromHair(dofs2)
+positions2 = np.zeros((steps // interval, dofs2.numPoints(), 3), dtype=np.float32)
+
+hair.stepMany([(model, dofs, roots), (model2, dofs2)], steps, [positions, None], interval)
+assert np.array_equal(positions[-1], view[:, :3])
+hair.stepMany(assets=[(model, dofs), (model2, dofs2, roots2)], steps=steps,
+              frames=[None, positions2], interval=interval)
+assert positions2.shape == (steps // interval, dofs2.numPoints(), 3)
+assert np.array_equal(positions2[-1], dofs2.getDoFs()[:, :3])
+
+states = np.zeros((steps // interval, numPoints, dofs.vertexSize()), dtype=np.float32)
+start = time.time()
+hair.stepMany(model, dofs, steps, roots, states, interval)
+seconds = time.time() - start
+assert states.shape == (steps // interval, numPoints, dofs.vertexSize())
+assert np.array_equal(states[-1], view)
+
+print("%d strands x %d points, %d steps" % (numHairs, pointsPerHair, steps))
+print("  %.1f steps/s" % (steps / seconds))
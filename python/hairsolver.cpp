@@ -0,0 +1,312 @@
+#ifdef NANOGUI_PYTHON
+
+#include "python.h"
+#include <pybind11/numpy.h>
+#include <algorithm>
+#include <cstring>
+#include "HairCreator.h"
+#include "HairParallel.h"
+#include "HairSolver.h"
+#include "HairWorld.h"
+
+/* The arrays returned by the hair classes are NumPy views of the solver
+   storage: nothing is copied in either direction, and each view keeps its
+   owner alive. Calls that change the topology (assign, adopt, resizeStrands,
+   resample, truncate) reallocate, so views taken before them must be
+   fetched again. */
+template <typename T>
+static py::array_t<T> view(py::handle owner, T *data, size_t rows, size_t cols) {
+    return py::array_t<T>(std::vector<size_t>{ rows, cols },
+                          std::vector<size_t>{ cols * sizeof(T), sizeof(T) }, data, owner);
+}
+
+template <typename T>
+static py::array_t<T> view(py::handle owner, T *data, size_t size) {
+    return py::array_t<T>(std::vector<size_t>{ size }, std::vector<size_t>{ sizeof(T) }, data, owner);
+}
+
+static size_t numStrands(HairDoF &dof) {
+    size_t size = (size_t) dof.getTopology().size();
+    return size > 0 ? size - 1 : 0;
+}
+
+typedef py::array_t<unsigned int, py::array::c_style | py::array::forcecast> OffsetArray;
+typedef py::array_t<float, py::array::c_style | py::array::forcecast> PointArray;
+
+/* Checks an offsets / points pair as HairGeo stores it and returns the strand count */
+static unsigned int checkGroom(const OffsetArray &offsets, const PointArray &points) {
+    if (offsets.ndim() != 1 || offsets.shape(0) < 1)
+        throw py::type_error("expected offsets of shape (numStrands + 1,)");
+    if (points.ndim() != 2 || points.shape(1) != 3)
+        throw py::type_error("expected points of shape (numPoints, 3)");
+    unsigned int nStrands = (unsigned int) offsets.shape(0) - 1;
+    if (offsets.data()[0] != 0 || offsets.data()[nStrands] != (unsigned int) points.shape(0))
+        throw py::value_error("offsets must run from 0 to the number of points");
+    for (unsigned int i = 0; i < nStrands; ++i) {
+        if (offsets.data()[i + 1] < offsets.data()[i])
+            throw py::value_error("offsets must not decrease");
+    }
+    return nStrands;
+}
+
+/* Frames of one asset for stepMany(): after every interval steps, the
+   positions (3 columns) or the whole DoFs (vertexSize columns) are copied
+   into the next (numPoints, columns) slice of a preallocated float32 array */
+struct FrameRecorder {
+    float *data = nullptr;
+    size_t numPoints = 0, columns = 0, frame = 0;
+
+    void record(HairDoF &dof) {
+        if (!data)
+            return;
+        const float *src = dof.getDoFs().data();
+        float *dst = data + frame++ * numPoints * columns;
+        size_t vtxSize = dof.vertexSize();
+        if (columns == vtxSize) {
+            HairParallel::copy(dst, src, sizeof(float) * numPoints * columns);
+            return;
+        }
+        int n = (int) numPoints;
+#pragma omp parallel for schedule(static)
+        for (int p = 0; p < n; p++)
+            std::memcpy(dst + 3 * (size_t) p, src + vtxSize * (size_t) p, 3 * sizeof(float));
+    }
+};
+
+static FrameRecorder frameRecorder(py::handle frames, HairDoF &dof, unsigned int numFrames) {
+    FrameRecorder recorder;
+    if (frames.ptr() == Py_None)
+        return recorder;
+    /* Anything that is not already an array would be converted to a temporary */
+    py::array array = py::array::ensure(frames);
+    if (!array || array.ptr() != frames.ptr() || array.dtype().kind() != 'f' || array.itemsize() != sizeof(float))
+        throw py::type_error("stepMany(): frames must be a float32 array");
+    size_t numPoints = (size_t) dof.getDoFs().size() / dof.vertexSize();
+    if (array.ndim() != 3 || (size_t) array.shape(0) != numFrames || (size_t) array.shape(1) != numPoints ||
+        (array.shape(2) != 3 && (size_t) array.shape(2) != dof.vertexSize()))
+        throw py::value_error("stepMany(): frames must have the shape (steps / interval, numPoints, 3 or vertexSize)");
+    /* Asked through the NumPy flags, which every pybind11 version can read */
+    py::object flags = array.attr("flags");
+    if (!flags.attr("writeable").cast<bool>() || !flags.attr("c_contiguous").cast<bool>())
+        throw py::value_error("stepMany(): frames must be a writable C-contiguous array");
+    recorder.data = (float *) array.data();
+    recorder.numPoints = numPoints;
+    recorder.columns = (size_t) array.shape(2);
+    return recorder;
+}
+
+/* Steps one asset (model, dof, roots or None) like an application loop does */
+static void stepOne(HairModel &model, HairDoF &dof, unsigned int steps, py::object roots,
+                    py::object frames, unsigned int interval) {
+    if (interval == 0)
+        throw py::value_error("stepMany(): interval must be at least 1");
+    HairDoF *rootDoF = roots.ptr() == Py_None ? nullptr : &roots.cast<HairDoF &>();
+    if (rootDoF == &dof)
+        throw py::value_error("stepMany(): roots must be another object than dof");
+    FrameRecorder recorder = frameRecorder(frames, dof, steps / interval);
+
+    py::gil_scoped_release release;
+    for (unsigned int s = 1; s <= steps; ++s) {
+        if (rootDoF) {
+            model.updateRoots(*rootDoF);
+            rootDoF->copyRootsToHair(dof);
+        }
+        model.step(dof);
+        if (s % interval == 0)
+            recorder.record(dof);
+    }
+}
+
+/* Steps a list of (model, dof[, roots]) tuples together on one HairWorld */
+static void stepAll(py::list assets, unsigned int steps, py::object frames, unsigned int interval) {
+    if (interval == 0)
+        throw py::value_error("stepMany(): interval must be at least 1");
+    size_t numAssets = assets.size();
+    py::list frameList;
+    if (frames.ptr() != Py_None) {
+        frameList = frames.cast<py::list>();
+        if (frameList.size() != numAssets)
+            throw py::value_error("stepMany(): expected one frames entry (or None) per asset");
+    }
+
+    HairWorld world;
+    std::vector<FrameRecorder> recorders;
+    std::vector<HairDoF *> written;
+    std::vector<HairModel *> models;
+    for (size_t i = 0; i < numAssets; ++i) {
+        py::tuple asset = assets[i].cast<py::tuple>();
+        if (asset.size() != 2 && asset.size() != 3)
+            throw py::value_error("stepMany(): assets must be (model, dof) or (model, dof, roots) tuples");
+        HairModel &model = asset[0].cast<HairModel &>();
+        HairDoF &dof = asset[1].cast<HairDoF &>();
+        HairDoF *roots = nullptr;
+        if (asset.size() == 3 && asset[2].ptr() != Py_None)
+            roots = &asset[2].cast<HairDoF &>();
+
+        /* Assets are stepped concurrently, so none may share written state
+           (models keep their scratch memory) */
+        for (HairDoF *d : written) {
+            if (d == &dof || d == roots)
+                throw py::value_error("stepMany(): a DoF object appears in more than one asset");
+        }
+        if (std::find(models.begin(), models.end(), &model) != models.end())
+            throw py::value_error("stepMany(): a model appears in more than one asset");
+        models.push_back(&model);
+        if (roots == &dof)
+            throw py::value_error("stepMany(): roots must be another object than dof");
+        written.push_back(&dof);
+        if (roots)
+            written.push_back(roots);
+
+        world.addAsset(std::to_string(i), dof, model, roots);
+        py::object entry = py::none();
+        if (frames.ptr() != Py_None)
+            entry = frameList[i];
+        recorders.push_back(frameRecorder(entry, dof, steps / interval));
+    }
+
+    py::gil_scoped_release release;
+    for (unsigned int s = 1; s <= steps; ++s) {
+        world.step();
+        if (s % interval != 0)
+            continue;
+        for (unsigned int a = 0; a < world.numAssets(); ++a)
+            recorders[a].record(*world.asset(a).dof);
+    }
+}
+
+void register_hairsolver(py::module &m) {
+    py::module h = m.def_submodule("hair", "Hair solver");
+
+    py::class_<HairGeo>(h, "HairGeo")
+        .def(py::init<>())
+        .def_static("fromArrays", [](OffsetArray offsets, PointArray points) {
+                unsigned int nStrands = checkGroom(offsets, points);
+                HairGeo geo;
+                geo.offsets.assign(offsets.data(), offsets.data() + nStrands + 1);
+                geo.points.resize((size_t) points.shape(0));
+                std::memcpy(geo.points.data(), points.data(), sizeof(float) * 3 * geo.points.size());
+                geo.update();
+                return geo;
+            }, py::arg("offsets"), py::arg("points"), "Copies a groom from offsets (numStrands + 1,) and points (numPoints, 3)")
+        .def("numStrands", &HairGeo::numStrands)
+        .def("numPoints", &HairGeo::numPoints)
+        .def("numSegments", &HairGeo::numSegments)
+        .def("points", [](py::object self) {
+                HairGeo &geo = self.cast<HairGeo &>();
+                return view(self, (float *) geo.points.data(), geo.points.size(), 3);
+            }, "Writable (numPoints, 3) view of the points")
+        .def("offsets", [](py::object self) {
+                HairGeo &geo = self.cast<HairGeo &>();
+                return view(self, geo.offsets.data(), geo.offsets.size());
+            }, "Writable (numStrands + 1,) view of the strand offsets")
+        .def("clear", &HairGeo::clear)
+        .def("truncate", &HairGeo::truncate, py::arg("numStrands"))
+        .def("resample", &HairGeo::resample, py::arg("pointsPerStrand"), py::arg("spacing") = 0.f);
+
+    py::class_<HairCreator>(h, "HairCreator")
+        .def_static("createRadialHair", &HairCreator::createRadialHair, py::arg("seed"),
+                    py::arg("numHairs"), py::arg("numPointsPerHair"), py::arg("hairLength"))
+        .def_static("resizeRadialHair", &HairCreator::resizeRadialHair, py::arg("geo"), py::arg("seed"),
+                    py::arg("numHairs"), py::arg("numPointsPerHair"), py::arg("hairLength"));
+
+    py::class_<HairDoF>(h, "HairDoF")
+        .def("vertexSize", &HairDoF::vertexSize)
+        .def("numStrands", [](HairDoF &dof) { return numStrands(dof); })
+        .def("numPoints", [](HairDoF &dof) { return (size_t) dof.getDoFs().size() / dof.vertexSize(); })
+        .def("getDoFs", [](py::object self) {
+                HairDoF &dof = self.cast<HairDoF &>();
+                return view(self, dof.getDoFs().data(), (size_t) dof.getDoFs().size() / dof.vertexSize(), dof.vertexSize());
+            }, "Writable (numPoints, vertexSize) view of the current DoFs")
+        .def("getPrevDoFs", [](py::object self) {
+                HairDoF &dof = self.cast<HairDoF &>();
+                return view(self, dof.getPrevDoFs().data(), (size_t) dof.getPrevDoFs().size() / dof.vertexSize(), dof.vertexSize());
+            }, "Writable (numPoints, vertexSize) view of the previous DoFs")
+        .def("getTopology", [](py::object self) {
+                HairDoF &dof = self.cast<HairDoF &>();
+                return view(self, dof.getTopology().data(), (size_t) dof.getTopology().size());
+            }, "Writable (numStrands + 1,) view of the strand offsets")
+        .def("getPointType", [](py::object self) {
+                HairDoF &dof = self.cast<HairDoF &>();
+                return view(self, dof.getPointType().data(), (size_t) dof.getPointType().size());
+            }, "Writable (numPoints,) view of the point types (0: fixed root)")
+        .def("assign", [](HairDoF &dof, const HairGeo &geo) { dof = geo; }, py::arg("geo"),
+             "Initializes from a groom, copying its points")
+        .def("assign", [](HairDoF &dof, OffsetArray offsets, PointArray points) {
+                unsigned int nStrands = checkGroom(offsets, points);
+                dof.assign(offsets.data(), nStrands, (const Eigen::Vector3f *) points.data());
+            }, py::arg("offsets"), py::arg("points"),
+             "Initializes from offsets (numStrands + 1,) and points (numPoints, 3)")
+        .def("adopt", [](HairDoF &dof, HairGeo &geo) { dof.adopt(std::move(geo)); }, py::arg("geo"),
+             "Takes the storage of geo, which is left empty")
+        .def("copyRootsFromHair", &HairDoF::copyRootsFromHair, py::arg("src"))
+        .def("copyRootsToHair", &HairDoF::copyRootsToHair, py::arg("dst"))
+        .def("resizeStrands", [](HairDoF &dof, const HairGeo &groom) { return dof.resizeStrands(groom); }, py::arg("groom"))
+        .def("resizeRootsFromHair", [](HairDoF &dof, HairDoF &hair) { dof.resizeRootsFromHair(hair); }, py::arg("hair"))
+        .def("resample", &HairDoF::resample, py::arg("pointsPerStrand"), py::arg("spacing") = 0.f)
+        .def("stateHash", &HairDoF::stateHash)
+        .def_readwrite("hairRadius", &HairDoF::mHairRadius);
+
+    py::class_<HairDoF_Points, HairDoF>(h, "HairDoF_Points")
+        .def(py::init<>());
+
+    py::class_<HairDoF_PointsAndQuaternions, HairDoF>(h, "HairDoF_PointsAndQuaternions")
+        .def(py::init<>());
+
+    py::class_<HairResidual>(h, "HairResidual")
+        .def_readonly("stretchShear", &HairResidual::stretchShear)
+        .def_readonly("bendTwist", &HairResidual::bendTwist);
+
+    py::class_<HairSolverStats>(h, "HairSolverStats")
+        .def_readonly("strands", &HairSolverStats::strands)
+        .def_readonly("iterations", &HairSolverStats::iterations)
+        .def_readonly("maxIterations", &HairSolverStats::maxIterations)
+        .def_readonly("converged", &HairSolverStats::converged)
+        .def_readonly("residual", &HairSolverStats::residual)
+        .def("meanIterations", &HairSolverStats::meanIterations);
+
+    py::class_<HairModel>(h, "HairModel")
+        .def("updateRoots", &HairModel::updateRoots, py::arg("roots"))
+        .def("step", &HairModel::step, py::arg("dof"))
+        .def("stepStrands", &HairModel::stepStrands, py::arg("dof"), py::arg("firstStrand"), py::arg("endStrand"))
+        .def("reset", &HairModel::reset)
+        .def_readwrite("timestep", &HairModel::mTimestep)
+        .def_readwrite("gravity", &HairModel::mGravity)
+        .def_readwrite("segmentLength", &HairModel::mSegmentLength)
+        .def_readwrite("stiffness", &HairModel::mStiffness)
+        .def_readwrite("rotXfreq", &HairModel::mRotXfreq)
+        .def_readwrite("rotYfreq", &HairModel::mRotYfreq)
+        .def_readwrite("rotZfreq", &HairModel::mRotZfreq)
+        .def_readwrite("rotXamp", &HairModel::mRotXamp)
+        .def_readwrite("rotYamp", &HairModel::mRotYamp)
+        .def_readwrite("rotZamp", &HairModel::mRotZamp)
+        .def_readwrite("currentTime", &HairModel::mCurrentTime)
+        .def_readwrite("transform", &HairModel::mTransform)
+        .def_readwrite("deterministic", &HairModel::mDeterministic);
+
+    py::class_<HairModel_FollowTheLeader, HairModel>(h, "HairModel_FollowTheLeader")
+        .def(py::init<>());
+
+    py::class_<HairModel_PBD_Cosserat, HairModel>(h, "HairModel_PBD_Cosserat")
+        .def(py::init<>())
+        .def("isAdaptive", &HairModel_PBD_Cosserat::isAdaptive)
+        .def_readwrite("tolerance", &HairModel_PBD_Cosserat::mTolerance)
+        .def_readwrite("relativeTolerance", &HairModel_PBD_Cosserat::mRelativeTolerance)
+        .def_readwrite("minIterations", &HairModel_PBD_Cosserat::mMinIterations)
+        .def_property_readonly("stats", [](const HairModel_PBD_Cosserat &model) { return model.mStats; });
+
+    /* Both release the GIL while stepping, so other Python threads keep
+       running; they must not touch the stepped objects until it returns */
+    h.def("stepMany", &stepOne, py::arg("model"), py::arg("dof"), py::arg("steps"),
+          py::arg("roots") = py::none(), py::arg("frames") = py::none(), py::arg("interval") = 1,
+          "Steps dof steps times, moving the roots first if given. With frames, a float32 array of "
+          "shape (steps / interval, numPoints, 3 or vertexSize), records the positions or DoFs "
+          "after every interval steps");
+    h.def("stepMany", &stepAll, py::arg("assets"), py::arg("steps"),
+          py::arg("frames") = py::none(), py::arg("interval") = 1,
+          "Steps a list of (model, dof) or (model, dof, roots) tuples together on the solver "
+          "thread pool (see HairWorld). frames is None or a list of one frames array (or None) "
+          "per asset");
+}
+
+#endif
@@ -51,6 +51,7 @@ extern void register_formhelper(py::module &m);
 extern void register_misc(py::module &m);
 extern void register_glutil(py::module &m);
 extern void register_nanovg(py::module &m);
+extern void register_hairsolver(py::module &m);
 
 class MainloopHandle;
 static MainloopHandle *handle = nullptr;
@@ -248,6 +249,7 @@ PYBIND11_PLUGIN(nanogui) {
     register_misc(m);
     register_glutil(m);
     register_nanovg(m);
+    register_hairsolver(m);
 
     return m.ptr();
 }
@@ -44,7 +44,9 @@
 #include <cstdint>
 #include <memory>
 #include <utility>
+#include <algorithm>
 #include <iomanip>
+#include <limits>
 
 #if defined(__GNUC__)
 #  pragma GCC diagnostic ignored "-Wmissing-field-initializers"
@@ -94,11 +96,15 @@ using std::to_string;
 
 class LogInfo {
 public:
-	LogInfo() : simulationTime(0), processingTime(0), frame(0){}
+	LogInfo() : simulationTime(0), processingTime(0), frame(0), deterministic(false), stateHash(0), meanIterations(0), maxIterations(0){}
 
 	float simulationTime;
 	float processingTime;
 	unsigned int frame;
+	bool deterministic;
+	unsigned long long stateHash;
+	float meanIterations;
+	unsigned int maxIterations;
 
 };
 
@@ -118,7 +124,7 @@ public:
 	unsigned int mNumStrands;
 	unsigned int mPointsPerStrand;
 
-	MyGLCanvas(Widget *parent) : nanogui::GLCanvas(parent), mRotation(nanogui::Vector3f(0, 0, 0)), mZoom(1.0f), mDragging(false), mRootColor(nanogui::Color(237,207,180,255)), mTipColor(nanogui::Color(123,0,0,255)), mStepsPerSecLabel(nullptr), mNumStrands(1000), mPointsPerStrand(10){
+	MyGLCanvas(Widget *parent) : nanogui::GLCanvas(parent), mRotation(nanogui::Vector3f(0, 0, 0)), mZoom(1.0f), mDragging(false), mRootColor(nanogui::Color(237,207,180,255)), mTipColor(nanogui::Color(123,0,0,255)), mStepsPerSecLabel(nullptr), mStepsLabel(nullptr), mSimtPerStepLabel(nullptr), mStateHashLabel(nullptr), mIterationsLabel(nullptr), mNumStrands(1000), mPointsPerStrand(10){
 
 		mShader.init(
 			/* An identifying name */
@@ -127,11 +133,13 @@ public:
 			/* Vertex shader */
 			"#version 330\n"
 			"uniform mat4 modelViewProj;\n"
+			"uniform vec3 rootColor;\n"
+			"uniform vec3 tipColor;\n"
 			"in vec3 position;\n"
-			"in vec3 color;\n"
+			"in float t;\n"
 			"out vec4 frag_color;\n"
 			"void main() {\n"
-			"    frag_color = vec4(color, 1.0);\n"
+			"    frag_color = vec4(mix(rootColor, tipColor, t), 1.0);\n"
 			"    gl_Position = modelViewProj * vec4(position, 1.0);\n"
 			"}",
 
@@ -147,52 +155,68 @@ public:
 		setHair();
 	}
 
+	// Positions are streamed straight from the DoFs (one memcpy into a
+	// persistently mapped ring); the shader skips the quaternions by stride.
 	void setHairPositions(HairDoF &hair) {
-		Eigen::VectorXf& dof = hair.getDoFs();
+		HairDoF::DoFArray& dof = hair.getDoFs();
 		auto vtxSize = hair.vertexSize();
 
-		auto numPts = dof.size() / vtxSize;
-		nanogui::MatrixXf positions(3, numPts);
-
-		for (auto i = 0u; i < numPts; i++)
-			positions.col(i) << dof[i * vtxSize], dof[i * vtxSize + 1], dof[i * vtxSize + 2];
-
 		mShader.bind();
-		mShader.uploadAttrib("position", positions);
+		mShader.streamAttrib("position", dof.data(), dof.size() / vtxSize, 3, vtxSize);
 		sSimulationDirty = false;
 	}
 
 	void setHairPositions(HairGeo &hair) {
-		auto numPoints = hair.numPoints();
-		nanogui::MatrixXf positions(3, numPoints);
+		mShader.bind();
+		mShader.streamAttrib("position", (const float *)hair.points.data(), hair.numPoints(), 3);
+	}
 
-		Eigen::Vector3f point;
-		hair.resetIter();
+	// Parameters and indices are rebuilt from strand firstStrand on; earlier
+	// strands did not change. The parameter is the root-to-tip t of every
+	// point, 8-bit normalized while strands have at most 256 points and 16-bit
+	// beyond; the shader blends the root and tip colors by it, so color edits
+	// upload nothing.
+	void setHairParameter(unsigned int firstStrand = 0) {
+		unsigned int maxPoints = 0;
+		for (auto i = 0u; i < mHair.numStrands(); i++) maxPoints = std::max(maxPoints, mHair.offsets[i + 1] - mHair.offsets[i]);
+
+		if (maxPoints <= 256) uploadParameter(mParameters8, firstStrand);
+		else uploadParameter(mParameters16, firstStrand);
+	}
 
-		for (auto pid = 0u; pid < numPoints; pid++) {
-			hair >> point;
-			positions.col(pid) << point(0), point(1), point(2);
+	template <typename T>
+	void uploadParameter(Eigen::Matrix<T, 1, Eigen::Dynamic> &parameters, unsigned int firstStrand) {
+		//switching between 8 and 16 bits starts over
+		if (!mShader.hasAttrib("t") || mShader.attribBuffer("t").compSize != sizeof(T)) {
+			mShader.freeAttrib("t");
+			firstStrand = 0;
 		}
+		parameters.conservativeResize(mHair.numPoints());
+		const float scale = (float)std::numeric_limits<T>::max();
+
+		mHair.forEachStrand([&](unsigned int strandId, ConstHairStrand strand) {
+			if (strandId < firstStrand) return;
+			for (auto i = 0u; i < strand.size(); i++)
+				parameters[strand.firstPoint() + i] = (T)(strand.t(i) * scale + 0.5f);
+		});
+
 		mShader.bind();
-		mShader.uploadAttrib("position", positions);
+		mShader.uploadAttrib("t", parameters);
 	}
 
-	void setHairColor() {
-		mHair.resetIter();
+	void setHairIndices(unsigned int firstStrand = 0) {
+		mIndices.conservativeResize(2, mHair.numSegments());
 
-		HairVertex vtx;
+		//radial grooms have no empty strands, so strand i starts at segment offsets[i] - i
+		mHair.forEachStrand([&](unsigned int strandId, ConstHairStrand strand) {
+			if (strandId < firstStrand) return;
+			unsigned int segmentId = strand.firstPoint() - strandId;
+			for (auto i = 0u; i + 1 < strand.size(); i++)
+				mIndices.col(segmentId + i) << strand.firstPoint() + i, strand.firstPoint() + i + 1;
+		});
 
-		auto numPoints = mHair.numPoints();
-		nanogui::MatrixXf colors(3, numPoints);		
-		
-		for (auto i = 0u; i < numPoints; i++) {
-			mHair >> vtx;
-			nanogui::Color c = mRootColor * (1 - vtx.t) + mTipColor * vtx.t;
-			colors.col(vtx.id) << c.r(), c.g(), c.b();
-		}
-		
 		mShader.bind();
-		mShader.uploadAttrib("color", colors);
+		mShader.uploadIndices(mIndices);
 	}
 
 	void setHair() {
@@ -201,24 +225,52 @@ public:
 
 		mHair.clear();
 		mHair = HairCreator::createRadialHair(0, mNumStrands, mPointsPerStrand, (mPointsPerStrand -1) * sHairModel.mSegmentLength);
-		auto numSegments = mHair.numSegments();
+		setHairIndices();
+		setHairParameter();
+		resetSolver();
 
-		mHair.resetIter();
+		if (isSimulating) RunOrPauseSimulation();
+	}
 
-		nanogui::MatrixXu indices(2, numSegments);
+	// Grows or shrinks the groom to mNumStrands without resetting the solver:
+	// remaining strands keep their state, new ones start at rest under the
+	// current root rotation.
+	void resizeHair() {
+		unsigned int oldStrands = mHair.numStrands();
+		if (mNumStrands == oldStrands) return;
 
-		HairSegment segment;
-		for (auto segId = 0u; segId < numSegments; segId++) {			
-			mHair >> segment;
-			indices.col(segId) << segment.a.id, segment.b.id;
+		bool isSimulating = simulationThread.joinable();
+		if (isSimulating) RunOrPauseSimulation();
+
+		HairCreator::resizeRadialHair(mHair, 0, mNumStrands, mPointsPerStrand, (mPointsPerStrand - 1) * sHairModel.mSegmentLength);
+		if (sHairDoFs.resizeStrands(mHair, sHairModel.mCurrentRootRotation)) {
+			sHairRoots.resizeRootsFromHair(sHairDoFs, sHairModel.mCurrentRootRotation);
+			unsigned int firstStrand = std::min(oldStrands, mNumStrands);
+			setHairIndices(firstStrand);
+			setHairParameter(firstStrand);
+			setHairPositions(sHairDoFs);
 		}
-		mShader.bind();
-		mShader.uploadIndices(indices);
-		setHairColor();
-		resetSolver();
+		else setHair();
 
 		if (isSimulating) RunOrPauseSimulation();
-    }
+	}
+
+	// Resamples every strand to mPointsPerStrand points, one segment length
+	// apart, along its current simulated shape.
+	void resampleHair() {
+		if (mHair.numStrands() == 0 || mHair.offsets[1] - mHair.offsets[0] == mPointsPerStrand) return;
+
+		bool isSimulating = simulationThread.joinable();
+		if (isSimulating) RunOrPauseSimulation();
+
+		mHair.resample(mPointsPerStrand, sHairModel.mSegmentLength);
+		sHairDoFs.resample(mPointsPerStrand, sHairModel.mSegmentLength);
+		setHairIndices();
+		setHairParameter();
+		setHairPositions(sHairDoFs);
+
+		if (isSimulating) RunOrPauseSimulation();
+	}
 
     ~MyGLCanvas() {
         mShader.free();
@@ -261,6 +313,11 @@ public:
 		info.frame = prevInfo.frame + 1;
 		info.processingTime = processingTime;
 		info.simulationTime = prevInfo.simulationTime + sHairModel.mTimestep;
+		info.deterministic = sHairModel.mDeterministic;
+		//hashed outside of the timed region, so processingTime compares both modes fairly
+		if (info.deterministic) info.stateHash = sHairDoFs.stateHash();
+		info.meanIterations = sHairModel.mStats.meanIterations();
+		info.maxIterations = sHairModel.mStats.maxIterations;
 
 		sSimulationLog.push_back(info);
 		simDirty = true;
@@ -293,6 +350,19 @@ public:
 			LogInfo &lastLog = sSimulationLog[sSimulationLog.size() - 1];
 			mStepsLabel->setCaption(std::to_string(lastLog.frame));
 		}
+		if (mStateHashLabel) {
+			LogInfo &lastLog = sSimulationLog[sSimulationLog.size() - 1];
+			std::stringstream stream;
+			if (lastLog.deterministic) stream << std::hex << std::setw(16) << std::setfill('0') << lastLog.stateHash;
+			else stream << "-";
+			mStateHashLabel->setCaption(stream.str());
+		}
+		if (mIterationsLabel) {
+			LogInfo &lastLog = sSimulationLog[sSimulationLog.size() - 1];
+			std::stringstream stream;
+			stream << std::fixed << std::setprecision(1) << lastLog.meanIterations << " (max " << lastLog.maxIterations << ")";
+			mIterationsLabel->setCaption(stream.str());
+		}
 
         using namespace nanogui;
 
@@ -305,6 +375,8 @@ public:
                                                    Eigen::AngleAxisf(mRotation[1]*fTime,  Vector3f::UnitY()) *
                                                    Eigen::AngleAxisf(mRotation[2]*fTime, Vector3f::UnitZ())) * mZoom;
         mShader.setUniform("modelViewProj", mvp);
+        mShader.setUniform("rootColor", Vector3f(mRootColor.r(), mRootColor.g(), mRootColor.b()));
+        mShader.setUniform("tipColor", Vector3f(mTipColor.r(), mTipColor.g(), mTipColor.b()));
         glEnable(GL_DEPTH_TEST);
         /* Draw numSegments segments starting at index 0 */
 		auto numSegments = mHair.numSegments();
@@ -351,14 +423,12 @@ public:
 
 	void setRootColor(const nanogui::Color &c) {
 		mRootColor = c;
-		setHairColor();
 	}
 	const nanogui::Color & getRootColor() const {
 		return mRootColor;
 	}
 	void setTipColor(const nanogui::Color &c) {
 		mTipColor = c;
-		setHairColor();
 	}
 	const nanogui::Color & getTipColor() const {
 		return mTipColor;
@@ -371,8 +441,8 @@ public:
 		sHairDoFs = mHair;
 		sHairRoots.copyRootsFromHair(sHairDoFs);
 
-		Eigen::VectorXf& dof = sHairDoFs.getDoFs();
-		Eigen::VectorXf& prevdof = sHairDoFs.getPrevDoFs();
+		HairDoF::DoFArray& dof = sHairDoFs.getDoFs();
+		HairDoF::DoFArray& prevdof = sHairDoFs.getPrevDoFs();
 
 		setHairPositions(sHairDoFs);
 		
@@ -389,6 +459,12 @@ public:
 	void setStepsLabel(nanogui::Label *l) {
 		mStepsLabel = l;
 	}
+	void setStateHashLabel(nanogui::Label *l) {
+		mStateHashLabel = l;
+	}
+	void setIterationsLabel(nanogui::Label *l) {
+		mIterationsLabel = l;
+	}
 private:
     nanogui::GLShader mShader;
 	bool mDragging;
@@ -396,13 +472,24 @@ private:
 	Eigen::Vector3f mInitRotation;
 	nanogui::Color mRootColor;
 	nanogui::Color mTipColor;
-	nanogui::Label *mStepsPerSecLabel, *mStepsLabel, *mSimtPerStepLabel;
+	nanogui::MatrixXu mIndices;
+	Eigen::Matrix<uint8_t, 1, Eigen::Dynamic> mParameters8;
+	Eigen::Matrix<uint16_t, 1, Eigen::Dynamic> mParameters16;
+	nanogui::Label *mStepsPerSecLabel, *mStepsLabel, *mSimtPerStepLabel, *mStateHashLabel, *mIterationsLabel;
 };
 
 void staticSetHair(MyGLCanvas *c) {
 	c->setHair();
 }
 
+void staticResizeHair(MyGLCanvas *c) {
+	c->resizeHair();
+}
+
+void staticResampleHair(MyGLCanvas *c) {
+	c->resampleHair();
+}
+
 template <typename T>
 class TypeField : public nanogui::Widget {
 public:
@@ -480,8 +567,8 @@ public:
 			Widget *props = new Widget(tools);
 			props->setLayout(new BoxLayout(Orientation::Vertical, Alignment::Fill, 0, 0));
 
-			new UintField(props, "N Hairs (x1000)", &mCanvas->mNumStrands, 1, 200, 1000, mCanvas, staticSetHair);
-			new UintField(props, "Points per Hair", &mCanvas->mPointsPerStrand, 2, 100, 1, mCanvas, staticSetHair);
+			new UintField(props, "N Hairs (x1000)", &mCanvas->mNumStrands, 1, 200, 1000, mCanvas, staticResizeHair);
+			new UintField(props, "Points per Hair", &mCanvas->mPointsPerStrand, 2, 100, 1, mCanvas, staticResampleHair);
 
 			new FloatField(props, "Rot X frequency", &sHairModel.mRotXfreq, 0, 1.0f, 1.0f);
 			new FloatField(props, "Rot X amplitude", &sHairModel.mRotXamp, 0, 1.0f, 1.0f);
@@ -502,6 +589,14 @@ public:
 			new FloatField(props, "Gravity Y", &sHairModel.mGravity, -10.0f, 10.0f, 1.0f);// m/ss
 			new FloatField(props, "Segment L", &sHairModel.mSegmentLength, 1.0f, 10.0f, 0.01f);//cm
 			new UintField(props, "Stiffness", &sHairModel.mStiffness, 0, 10, 10);
+			//iterations stop early per strand once the residuals are within a tolerance
+			new FloatField(props, "Tolerance", &sHairModel.mTolerance, 0, 10.0f, 0.001f);
+			new FloatField(props, "Rel. tolerance", &sHairModel.mRelativeTolerance, 0, 1.0f, 0.001f);
+			new UintField(props, "Min iterations", &sHairModel.mMinIterations, 1, 10, 1);
+
+			auto deterministic = new CheckBox(props, "Deterministic");
+			deterministic->setChecked(sHairModel.mDeterministic);
+			deterministic->setCallback([](bool value) { sHairModel.mDeterministic = value; });
 
 			mTabs[1] = props;
 			tabLay->setAnchor(props, AdvancedGridLayout::Anchor(0, 1, nanogui::Alignment::Fill, nanogui::Alignment::Minimum));
@@ -539,6 +634,10 @@ public:
 		mCanvas->setSimtimePerStepLabel(new Label(playbackPanel, "0.0    "));
 		new Label(playbackPanel, "Step:");
 		mCanvas->setStepsLabel(new Label(playbackPanel, "0      "));
+		new Label(playbackPanel, "State hash:");
+		mCanvas->setStateHashLabel(new Label(playbackPanel, "-                "));
+		new Label(playbackPanel, "Iterations:");
+		mCanvas->setIterationsLabel(new Label(playbackPanel, "0.0 (max 0)   "));
 
 		winLay->setAnchor(playbackPanel, AdvancedGridLayout::Anchor(0, 1, 2, 1,nanogui::Alignment::Fill, nanogui::Alignment::Fill));
 		 
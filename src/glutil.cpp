@@ -17,6 +17,8 @@
 #  endif
 #endif
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <Eigen/Geometry>
@@ -176,6 +178,10 @@ void GLShader::uploadAttrib(const std::string &name, size_t size, int dim,
             return;
     }
 
+    /* Streamed storage may be immutable; start over with a plain buffer */
+    if (mStreams.find(name) != mStreams.end())
+        freeAttrib(name);
+
     GLuint bufferID;
     auto it = mBufferObjects.find(name);
     if (it != mBufferObjects.end()) {
@@ -184,6 +190,8 @@ void GLShader::uploadAttrib(const std::string &name, size_t size, int dim,
         buffer.version = version;
         buffer.size = (GLuint) size;
         buffer.compSize = compSize;
+        buffer.stride = 0;
+        buffer.offset = 0;
     } else {
         glGenBuffers(1, &bufferID);
         Buffer buffer;
@@ -193,6 +201,8 @@ void GLShader::uploadAttrib(const std::string &name, size_t size, int dim,
         buffer.compSize = compSize;
         buffer.size = (GLuint) size;
         buffer.version = version;
+        buffer.stride = 0;
+        buffer.offset = 0;
         mBufferObjects[name] = buffer;
     }
     size_t totalSize = size * (size_t) compSize;
@@ -219,18 +229,194 @@ void GLShader::downloadAttrib(const std::string &name, size_t size, int /* dim *
         throw std::runtime_error("downloadAttrib(" + mName + ", " + name + ") : buffer not found!");
 
     const Buffer &buf = it->second;
-    if (buf.size != size || buf.compSize != compSize)
+    size_t stride = std::max(buf.stride, buf.dim);
+    size_t count = buf.size == 0 ? 0 : (buf.size - buf.dim) / stride + 1;
+    if (count * buf.dim != size || buf.compSize != compSize)
         throw std::runtime_error(mName + ": downloadAttrib: size mismatch!");
 
-    size_t totalSize = size * (size_t) compSize;
+    GLenum target = name == "indices" ? GL_ELEMENT_ARRAY_BUFFER : GL_ARRAY_BUFFER;
+    size_t totalSize = buf.size * (size_t) compSize;
+    glBindBuffer(target, buf.id);
 
-    if (name == "indices") {
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buf.id);
-        glGetBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, totalSize, data);
+    if (stride == buf.dim) {
+        glGetBufferSubData(target, buf.offset, totalSize, data);
+    } else {
+        /* Streamed with a stride: fetch the interleaved range, keep the first dim components of each vertex */
+        std::vector<uint8_t> interleaved(totalSize);
+        glGetBufferSubData(target, buf.offset, totalSize, interleaved.data());
+        size_t vertexBytes = buf.dim * (size_t) compSize, strideBytes = stride * (size_t) compSize;
+        for (size_t i = 0; i < count; ++i)
+            memcpy((uint8_t *) data + i * vertexBytes, interleaved.data() + i * strideBytes, vertexBytes);
+    }
+}
+
+/* glBufferStorage is core in OpenGL 4.4, past what GLAD and macOS provide */
+#if !defined(GL_MAP_PERSISTENT_BIT)
+#  define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#if !defined(GL_MAP_COHERENT_BIT)
+#  define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+typedef void (APIENTRYP BufferStorageProc)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+
+static BufferStorageProc bufferStorage() {
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    bool supported = major > 4 || (major == 4 && minor >= 4);
+
+    GLint extensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extensions);
+    for (GLint i = 0; i < extensions && !supported; ++i) {
+        const char *extension = (const char *) glGetStringi(GL_EXTENSIONS, (GLuint) i);
+        supported = extension && std::strcmp(extension, "GL_ARB_buffer_storage") == 0;
+    }
+    if (!supported)
+        return nullptr;
+
+#if defined(GL_VERSION_4_4) && !defined(NANOGUI_GLAD)
+    return glBufferStorage;
+#else
+    return (BufferStorageProc) glfwGetProcAddress("glBufferStorage");
+#endif
+}
+
+void GLShader::streamAttrib(const std::string &name, size_t count, int dim, int stride,
+                            uint32_t compSize, GLuint glType, bool integral,
+                            const void *data, StreamMode mode) {
+    int attribID = attrib(name);
+    if (attribID < 0)
+        return;
+    if (stride < dim)
+        stride = dim;
+
+    /* The last vertex need not be padded to the full stride */
+    size_t size = count == 0 ? 0 : (count - 1) * (size_t) stride + (size_t) dim;
+    size_t bytes = size * (size_t) compSize;
+
+    static BufferStorageProc storageProc = bufferStorage();
+    if (mode == StreamMode::Persistent && !storageProc)
+        mode = StreamMode::Orphan;
+
+    auto it = mBufferObjects.find(name);
+    auto streamIt = mStreams.find(name);
+    bool fits = streamIt != mStreams.end() && streamIt->second.mode == mode &&
+                bytes <= streamIt->second.capacity;
+
+    if (!fits) {
+        /* Grow by half again, so that slowly growing data does not reallocate every frame */
+        size_t capacity = streamIt != mStreams.end() && streamIt->second.mode == mode
+                              ? std::max(bytes, streamIt->second.capacity + streamIt->second.capacity / 2)
+                              : bytes;
+        if (it != mBufferObjects.end())
+            freeAttrib(name);
+
+        Buffer buffer;
+        glGenBuffers(1, &buffer.id);
+        buffer.glType = glType;
+        buffer.dim = dim;
+        buffer.compSize = compSize;
+        buffer.size = 0;
+        buffer.version = -1;
+        buffer.stride = 0;
+        buffer.offset = 0;
+        it = mBufferObjects.insert(std::make_pair(name, buffer)).first;
+
+        Stream stream;
+        stream.mode = mode;
+        stream.capacity = capacity;
+        stream.frame = 0;
+        stream.mapped = nullptr;
+        for (int i = 0; i < StreamFrames; ++i)
+            stream.fences[i] = nullptr;
+
+        glBindBuffer(GL_ARRAY_BUFFER, buffer.id);
+        if (mode == StreamMode::Persistent && capacity == 0) {
+            /* Nothing to map yet; the first non-empty frame reallocates */
+        } else if (mode == StreamMode::Persistent) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            storageProc(GL_ARRAY_BUFFER, (GLsizeiptr) (capacity * StreamFrames), nullptr, flags);
+            stream.mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, (GLsizeiptr) (capacity * StreamFrames), flags);
+            if (!stream.mapped)
+                throw std::runtime_error(mName + ": streamAttrib: could not map " + name + "!");
+        } else {
+            glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) capacity, nullptr, GL_STREAM_DRAW);
+        }
+        streamIt = mStreams.insert(std::make_pair(name, stream)).first;
+    }
+
+    Buffer &buffer = it->second;
+    Stream &stream = streamIt->second;
+    glBindBuffer(GL_ARRAY_BUFFER, buffer.id);
+
+    switch (mode) {
+        case StreamMode::Orphan:
+            glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) stream.capacity, nullptr, GL_STREAM_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr) bytes, data);
+            break;
+
+        case StreamMode::SubData:
+            glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr) bytes, data);
+            break;
+
+        case StreamMode::Persistent: {
+            /* Wait until the GPU has drawn the frame this one overwrites */
+            stream.frame = (stream.frame + 1) % StreamFrames;
+            GLsync &fence = stream.fences[stream.frame];
+            if (fence) {
+                GLenum status;
+                do {
+                    status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+                } while (status == GL_TIMEOUT_EXPIRED);
+                glDeleteSync(fence);
+                fence = nullptr;
+            }
+            buffer.offset = (GLuint) (stream.frame * stream.capacity);
+            if (bytes > 0)
+                std::memcpy((uint8_t *) stream.mapped + buffer.offset, data, bytes);
+            break;
+        }
+    }
+
+    buffer.size = (GLuint) size;
+    buffer.stride = (GLuint) stride;
+    if (count == 0) {
+        glDisableVertexAttribArray(attribID);
     } else {
-        glBindBuffer(GL_ARRAY_BUFFER, buf.id);
-        glGetBufferSubData(GL_ARRAY_BUFFER, 0, totalSize, data);
+        glEnableVertexAttribArray(attribID);
+        glVertexAttribPointer(attribID, dim, glType, integral, (GLsizei) (stride * compSize),
+                              (const void *) (size_t) buffer.offset);
+    }
+}
+
+void GLShader::fenceStreams() {
+    for (auto &item : mStreams) {
+        Stream &stream = item.second;
+        if (stream.mode != StreamMode::Persistent)
+            continue;
+        /* A later fence also covers the earlier draws of the frame */
+        GLsync &fence = stream.fences[stream.frame];
+        if (fence)
+            glDeleteSync(fence);
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+}
+
+void GLShader::freeStream(const std::string &name) {
+    auto it = mStreams.find(name);
+    if (it == mStreams.end())
+        return;
+    Stream &stream = it->second;
+    for (int i = 0; i < StreamFrames; ++i) {
+        if (stream.fences[i])
+            glDeleteSync(stream.fences[i]);
+    }
+    if (stream.mapped) {
+        glBindBuffer(GL_ARRAY_BUFFER, mBufferObjects[name].id);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
     }
+    mStreams.erase(it);
 }
 
 void GLShader::shareAttrib(const GLShader &otherShader, const std::string &name, const std::string &_as) {
@@ -246,7 +432,8 @@ void GLShader::shareAttrib(const GLShader &otherShader, const std::string &name,
             return;
         glEnableVertexAttribArray(attribID);
         glBindBuffer(GL_ARRAY_BUFFER, buffer.id);
-        glVertexAttribPointer(attribID, buffer.dim, buffer.glType, buffer.compSize == 1 ? GL_TRUE : GL_FALSE, 0, 0);
+        glVertexAttribPointer(attribID, buffer.dim, buffer.glType, buffer.compSize == 1 ? GL_TRUE : GL_FALSE,
+                              (GLsizei) (buffer.stride * buffer.compSize), (const void *) (size_t) buffer.offset);
     } else {
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer.id);
     }
@@ -258,6 +445,7 @@ void GLShader::invalidateAttribs() {
 }
 
 void GLShader::freeAttrib(const std::string &name) {
+    freeStream(name);
     auto it = mBufferObjects.find(name);
     if (it != mBufferObjects.end()) {
         glDeleteBuffers(1, &it->second.id);
@@ -278,6 +466,7 @@ void GLShader::drawIndexed(int type, uint32_t offset_, uint32_t count_) {
 
     glDrawElements(type, (GLsizei) count, GL_UNSIGNED_INT,
                    (const void *)(offset * sizeof(uint32_t)));
+    fenceStreams();
 }
 
 void GLShader::drawArray(int type, uint32_t offset, uint32_t count) {
@@ -285,9 +474,12 @@ void GLShader::drawArray(int type, uint32_t offset, uint32_t count) {
         return;
 
     glDrawArrays(type, offset, count);
+    fenceStreams();
 }
 
 void GLShader::free() {
+    while (!mStreams.empty())
+        freeStream(mStreams.begin()->first);
     for (auto &buf: mBufferObjects)
         glDeleteBuffers(1, &buf.second.id);
     mBufferObjects.clear();
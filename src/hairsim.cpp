@@ -0,0 +1,256 @@
+/*
+    src/hairsim.cpp -- headless hair simulation driver
+
+    Simulates a radial groom without a window and reports the step rate and
+    the final state hash. With --workers N the groom is split over N local
+    worker processes sharing one memory segment (see HairSharedSolver).
+
+    hairsim [--hairs N] [--points N] [--steps N] [--stiffness N] [--workers N]
+            [--tolerance X] [--relative-tolerance X] [--min-iterations N]
+            [--checkpoint N] [--resume FILE] [--mesh FILE] [--tube-sides N]
+    hairsim --sweep [--timesteps LIST] [--segments LIST] [--stiffnesses LIST]
+            [--radii LIST] [--random N] [--seed N] [--table FILE] ...
+
+    --tolerance and --relative-tolerance stop the iterations of a strand (at
+    most --stiffness) once each residual is within X, or down to X times
+    its first iteration's value (see HairModel_PBD_Cosserat::mTolerance).
+
+    --checkpoint N writes hairsim.hckpt every N steps in the background;
+    --resume continues from such a checkpoint.
+
+    --mesh writes the final state as a Wavefront OBJ mesh for rendering:
+    ribbons facing +z, or tubes of N sides with --tube-sides (see HairMesh).
+
+    --sweep runs the groom once per combination of the comma separated
+    values (or, with --random N, for N settings drawn between the smallest
+    and largest of each list) and prints a CSV table of the runs (see
+    HairSweep), or writes it to --table.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "hairsolver/HairCreator.h"
+#include "hairsolver/HairSolver.h"
+#include "hairsolver/HairSharedSolver.h"
+#include "hairsolver/HairCheckpoint.h"
+#include "hairsolver/HairSweep.h"
+#include "hairsolver/HairMesh.h"
+
+#if defined(_WIN32)
+#  include <process.h>
+#  define getpid _getpid
+#else
+#  include <unistd.h>
+#endif
+
+using std::cout;
+using std::endl;
+
+struct Options {
+	unsigned int numHairs = 10000;
+	unsigned int pointsPerHair = 16;
+	unsigned int steps = 200;
+	unsigned int stiffness = 4;
+	float tolerance = 0;
+	float relativeTolerance = 0;
+	unsigned int minIterations = 1;
+	unsigned int workers = 0;
+	unsigned int checkpointInterval = 0;
+	std::string resume;
+	std::string mesh;
+	unsigned int tubeSides = 0;
+
+	bool sweep = false;
+	std::vector<float> timesteps;
+	std::vector<float> segmentLengths;
+	std::vector<unsigned int> stiffnesses;
+	std::vector<float> hairRadii;
+	unsigned int randomRuns = 0;
+	unsigned int seed = 0;
+	std::string table;
+};
+
+static void usage() {
+	cout << "usage: hairsim [--hairs N] [--points N] [--steps N] [--stiffness N] [--tolerance X] [--relative-tolerance X] [--min-iterations N] [--workers N] [--checkpoint N] [--resume FILE] [--mesh FILE] [--tube-sides N]" << endl;
+	cout << "       hairsim --sweep [--timesteps LIST] [--segments LIST] [--stiffnesses LIST] [--radii LIST] [--random N] [--seed N] [--table FILE]" << endl;
+}
+
+template <typename T>
+static std::vector<T> parseList(const std::string &text) {
+	std::vector<T> values;
+	std::stringstream stream(text);
+	std::string item;
+	while (std::getline(stream, item, ',')) values.push_back((T)std::strtod(item.c_str(), nullptr));
+	return values;
+}
+
+static bool parseOptions(int argc, char **argv, Options &o) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--sweep") {
+			o.sweep = true;
+			continue;
+		}
+		if (i + 1 >= argc) return false;
+		std::string text = argv[++i];
+		unsigned int value = (unsigned int)std::strtoul(text.c_str(), nullptr, 10);
+		if (arg == "--hairs") o.numHairs = value;
+		else if (arg == "--points") o.pointsPerHair = value;
+		else if (arg == "--steps") o.steps = value;
+		else if (arg == "--stiffness") o.stiffness = value;
+		else if (arg == "--tolerance") o.tolerance = (float)std::strtod(text.c_str(), nullptr);
+		else if (arg == "--relative-tolerance") o.relativeTolerance = (float)std::strtod(text.c_str(), nullptr);
+		else if (arg == "--min-iterations") o.minIterations = value;
+		else if (arg == "--workers") o.workers = value;
+		else if (arg == "--checkpoint") o.checkpointInterval = value;
+		else if (arg == "--resume") o.resume = text;
+		else if (arg == "--mesh") o.mesh = text;
+		else if (arg == "--tube-sides") o.tubeSides = value;
+		else if (arg == "--timesteps") o.timesteps = parseList<float>(text);
+		else if (arg == "--segments") o.segmentLengths = parseList<float>(text);
+		else if (arg == "--stiffnesses") o.stiffnesses = parseList<unsigned int>(text);
+		else if (arg == "--radii") o.hairRadii = parseList<float>(text);
+		else if (arg == "--random") o.randomRuns = value;
+		else if (arg == "--seed") o.seed = value;
+		else if (arg == "--table") o.table = text;
+		else return false;
+	}
+	return o.numHairs > 0 && o.pointsPerHair > 1;
+}
+
+//lists left empty sweep only the default model setting
+static int runSweep(Options &o) {
+	HairModel_PBD_Cosserat model;
+	model.mRotYfreq = 1.0f;
+	model.mRotYamp = 0.1f;
+	model.mTolerance = o.tolerance;
+	model.mRelativeTolerance = o.relativeTolerance;
+	model.mMinIterations = o.minIterations;
+	if (o.timesteps.empty()) o.timesteps.push_back(model.mTimestep);
+	if (o.segmentLengths.empty()) o.segmentLengths.push_back(model.mSegmentLength);
+	if (o.stiffnesses.empty()) o.stiffnesses.push_back(o.stiffness);
+	if (o.hairRadii.empty()) o.hairRadii.push_back(HairDoF_PointsAndQuaternions().mHairRadius);
+
+	HairSweep sweep;
+	if (o.randomRuns > 0) {
+		HairSweep::Params lo = { *std::min_element(o.timesteps.begin(), o.timesteps.end()), *std::min_element(o.segmentLengths.begin(), o.segmentLengths.end()),
+			*std::min_element(o.stiffnesses.begin(), o.stiffnesses.end()), *std::min_element(o.hairRadii.begin(), o.hairRadii.end()) };
+		HairSweep::Params hi = { *std::max_element(o.timesteps.begin(), o.timesteps.end()), *std::max_element(o.segmentLengths.begin(), o.segmentLengths.end()),
+			*std::max_element(o.stiffnesses.begin(), o.stiffnesses.end()), *std::max_element(o.hairRadii.begin(), o.hairRadii.end()) };
+		sweep.addRandom(o.randomRuns, lo, hi, o.seed);
+	}
+	else sweep.addGrid(o.timesteps, o.segmentLengths, o.stiffnesses, o.hairRadii);
+
+	HairGeo hair = HairCreator::createRadialHair(o.seed, o.numHairs, o.pointsPerHair, (o.pointsPerHair - 1) * model.mSegmentLength);
+	if (!sweep.run(hair, model, o.steps)) return 1;
+
+	if (o.table.empty()) sweep.writeTable(cout);
+	else {
+		std::ofstream file(o.table);
+		sweep.writeTable(file);
+		if (!file.good()) {
+			cout << "hairsim error: could not write " << o.table << endl;
+			return 1;
+		}
+	}
+
+	unsigned int nStable = 0;
+	for (auto &r : sweep.mResults) nStable += r.stable ? 1 : 0;
+	cout << sweep.mRuns.size() << " runs of " << o.numHairs << " strands x " << o.pointsPerHair << " points, " << o.steps << " steps, " << nStable << " stable" << endl;
+	cout << "  " << sweep.mSeconds << " s, " << sweep.mRuns.size() * o.steps / sweep.mSeconds << " run steps/s" << endl;
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	if (argc == 4 && std::strcmp(argv[1], "--worker") == 0)
+		return HairSharedSolver::runWorker(argv[2], (unsigned int)std::strtoul(argv[3], nullptr, 10));
+
+	Options options;
+	if (!parseOptions(argc, argv, options)) {
+		usage();
+		return 1;
+	}
+	if (options.sweep) return runSweep(options);
+
+	HairModel_PBD_Cosserat model;
+	model.mStiffness = options.stiffness;
+	model.mTolerance = options.tolerance;
+	model.mRelativeTolerance = options.relativeTolerance;
+	model.mMinIterations = options.minIterations;
+	model.mRotYfreq = 1.0f;
+	model.mRotYamp = 0.1f;
+
+	HairDoF_PointsAndQuaternions dofs, roots;
+	HairGeo hair = HairCreator::createRadialHair(0, options.numHairs, options.pointsPerHair, (options.pointsPerHair - 1) * model.mSegmentLength);
+	dofs.adopt(std::move(hair));
+	roots.copyRootsFromHair(dofs);
+	if (!options.resume.empty() && !HairCheckpoint::load(options.resume, model, dofs, &roots)) return 1;
+
+	HairSharedSolver shared;
+	if (options.workers > 0) {
+		std::string name = "hairsim_" + std::to_string(getpid());
+		if (!shared.create(name, dofs, model, options.workers) || !shared.launchWorkers(argv[0])) return 1;
+	}
+
+	HairCheckpointWriter checkpoints;
+	double checkpointSeconds = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	for (auto s = 0u; s < options.steps; s++) {
+		model.updateRoots(roots);
+		if (options.workers > 0) {
+			if (!shared.step(roots)) return 1;
+		}
+		else {
+			roots.copyRootsToHair(dofs);
+			model.step(dofs);
+		}
+
+		if (options.checkpointInterval > 0 && (s + 1) % options.checkpointInterval == 0) {
+			checkpoints.snapshot("hairsim.hckpt", model, dofs, &roots);
+			checkpointSeconds += checkpoints.mCopySeconds;
+		}
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	shared.shutdown();
+	if (!checkpoints.wait()) return 1;
+
+	cout << options.numHairs << " strands x " << options.pointsPerHair << " points, " << options.steps << " steps";
+	if (options.workers > 0) cout << " on " << options.workers << " worker processes";
+	cout << endl;
+	cout << "  " << options.steps / seconds << " steps/s, " << (double)options.numHairs * options.pointsPerHair * options.steps / seconds * 1e-6 << " Mpoints/s" << endl;
+	if (options.checkpointInterval > 0) cout << "  " << checkpointSeconds * 1000.0 << " ms in checkpoint snapshots" << endl;
+	if (model.isAdaptive() && options.workers == 0) {
+		const HairSolverStats &stats = model.mStats;
+		cout << "  last step: " << stats.meanIterations() << " iterations per strand (max " << stats.maxIterations << "), "
+			<< stats.converged << "/" << stats.strands << " strands converged, residual " << stats.residual.stretchShear << " / " << stats.residual.bendTwist << endl;
+	}
+	cout << "  state hash " << std::hex << dofs.stateHash() << std::dec << endl;
+
+	if (!options.mesh.empty()) {
+		HairMesh mesh;
+		if (options.tubeSides > 0) {
+			mesh.mType = HairMesh::Tubes;
+			mesh.mSides = options.tubeSides;
+		}
+		auto meshStart = std::chrono::steady_clock::now();
+		if (!mesh.generate(dofs)) return 1;
+		double meshSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - meshStart).count();
+
+		std::ofstream file(options.mesh);
+		if (!mesh.writeObj(file)) {
+			cout << "hairsim error: could not write " << options.mesh << endl;
+			return 1;
+		}
+		cout << "  mesh of " << mesh.numVertices() << " vertices, " << mesh.numIndices() / 3 << " triangles in " << meshSeconds * 1000.0 << " ms" << endl;
+	}
+	return 0;
+}
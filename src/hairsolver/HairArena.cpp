@@ -0,0 +1,165 @@
+#include "HairArena.h"
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#ifdef HAIR_HEAP_GUARD
+#include <cstdio>
+#include <mutex>
+#include <Eigen/Core>
+#endif
+
+namespace {
+
+const size_t sMinBlockSize = 1 << 16;
+
+size_t alignUp(size_t value, size_t alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+}
+
+HairArena::HairArena() : mFirst(nullptr), mCurrent(nullptr), mOffset(0), mUsedBefore(0), mHighWaterMark(0), mNumBlockAllocations(0) {}
+
+HairArena::~HairArena() {
+	release();
+}
+
+HairArena::HairArena(const HairArena &) : mFirst(nullptr), mCurrent(nullptr), mOffset(0), mUsedBefore(0), mHighWaterMark(0), mNumBlockAllocations(0) {}
+
+HairArena &HairArena::operator=(const HairArena &) {
+	return *this;
+}
+
+void HairArena::release() {
+	Block *b = mFirst;
+	while (b) {
+		Block *next = b->next;
+		std::free(b);
+		b = next;
+	}
+	mFirst = mCurrent = nullptr;
+	mOffset = 0;
+	mUsedBefore = 0;
+}
+
+void HairArena::addBlock(size_t minBytes) {
+	size_t size = minBytes > sMinBlockSize ? minBytes : sMinBlockSize;
+	if (mCurrent && size < 2 * mCurrent->size) size = 2 * mCurrent->size;
+
+	//malloc rather than new, so that growing is not reported by HairHeapGuard
+	Block *b = (Block *)std::malloc(sizeof(Block) + size);
+	if (!b) throw std::bad_alloc();
+	b->next = nullptr;
+	b->size = size;
+	mNumBlockAllocations++;
+
+	if (mCurrent) {
+		mUsedBefore += mOffset;
+		mCurrent->next = b;
+	}
+	else {
+		mFirst = b;
+	}
+	mCurrent = b;
+	mOffset = 0;
+}
+
+void *HairArena::allocate(size_t bytes, size_t alignment) {
+	if (!mCurrent) addBlock(bytes + alignment);
+
+	uintptr_t base = (uintptr_t)blockData(mCurrent);
+	size_t offset = alignUp(base + mOffset, alignment) - base;
+	if (offset + bytes > mCurrent->size) {
+		addBlock(bytes + alignment);
+		base = (uintptr_t)blockData(mCurrent);
+		offset = alignUp(base, alignment) - base;
+	}
+
+	mOffset = offset + bytes;
+	if (used() > mHighWaterMark) mHighWaterMark = used();
+	return (void *)(base + offset);
+}
+
+void HairArena::reset() {
+	//merge an overflowed chain into one block that fits the whole step
+	if (mFirst && mFirst->next) {
+		size_t size = mHighWaterMark + 64 * 16;
+		release();
+		addBlock(size);
+	}
+	mCurrent = mFirst;
+	mOffset = 0;
+	mUsedBefore = 0;
+}
+
+void HairArena::reserve(size_t bytes) {
+	if (mFirst && mFirst->size >= bytes) return;
+	release();
+	addBlock(bytes);
+}
+
+size_t HairArena::capacity() const {
+	size_t c = 0;
+	for (Block *b = mFirst; b; b = b->next) c += b->size;
+	return c;
+}
+
+#ifdef HAIR_HEAP_GUARD
+
+namespace {
+
+//depth and scope are per thread: a guard only checks the thread it lives on,
+//so solver loops open their own guards on the worker threads
+thread_local int sGuardDepth = 0;
+thread_local const char *sGuardScope = nullptr;
+
+//Eigen's malloc flag is process wide; it is cleared while any thread is guarded
+std::mutex sEigenMutex;
+int sGuardedThreads = 0;
+
+void *guardedAlloc(size_t size) {
+	if (sGuardDepth > 0) {
+		std::fprintf(stderr, "HairHeapGuard error: %zu byte heap allocation in %s\n", size, sGuardScope ? sGuardScope : "guarded scope");
+		std::abort();
+	}
+	void *p = std::malloc(size ? size : 1);
+	if (!p) throw std::bad_alloc();
+	return p;
+}
+
+}
+
+HairHeapGuard::HairHeapGuard(const char *scope) {
+	mPreviousScope = sGuardScope;
+	sGuardScope = scope;
+	if (sGuardDepth++ == 0) {
+		std::lock_guard<std::mutex> lock(sEigenMutex);
+		if (sGuardedThreads++ == 0) {
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+			Eigen::internal::set_is_malloc_allowed(false);
+#endif
+		}
+	}
+}
+
+HairHeapGuard::~HairHeapGuard() {
+	if (--sGuardDepth == 0) {
+		std::lock_guard<std::mutex> lock(sEigenMutex);
+		if (--sGuardedThreads == 0) {
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+			Eigen::internal::set_is_malloc_allowed(true);
+#endif
+		}
+	}
+	sGuardScope = mPreviousScope;
+}
+
+void *operator new(size_t size) { return guardedAlloc(size); }
+void *operator new[](size_t size) { return guardedAlloc(size); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
+
+#endif
@@ -0,0 +1,275 @@
+#include "HairCache.h"
+#include "HairSolver.h"
+#include "HairCodec.h"
+#include <iostream>
+#include <cstring>
+
+static const char sCacheMagic[8] = { 'H', 'A', 'I', 'R', 'C', 'A', 'C', 'H' };
+static const uint32_t sCacheVersion = 1;
+static const uint64_t sCacheAlignment = 64;
+
+HairCacheWriter::HairCacheWriter() {
+	std::memset(&mHeader, 0, sizeof(mHeader));
+}
+
+HairCacheWriter::~HairCacheWriter() {
+	close();
+}
+
+void HairCacheWriter::pad() {
+	static const char zeros[sCacheAlignment] = {};
+	uint64_t pos = (uint64_t)mFile.tellp();
+	uint64_t rem = pos % sCacheAlignment;
+	if (rem) mFile.write(zeros, sCacheAlignment - rem);
+}
+
+bool HairCacheWriter::open(const std::string &filename, HairDoF &dof, bool storeQuaternions) {
+	close();
+
+	if (storeQuaternions && dof.vertexSize() != 7) {
+		std::cout << "HairCacheWriter error: dof has no quaternions" << std::endl;
+		return false;
+	}
+
+	mFile.open(filename, std::ios::out | std::ios::trunc | std::ios::binary);
+	if (!mFile.is_open()) {
+		std::cout << "HairCacheWriter error: could not open " << filename << std::endl;
+		return false;
+	}
+
+	HairDoF::IndexArray &topo = dof.getTopology();
+
+	std::memset(&mHeader, 0, sizeof(mHeader));
+	std::memcpy(mHeader.magic, sCacheMagic, sizeof(sCacheMagic));
+	mHeader.version = sCacheVersion;
+	mHeader.flags = storeQuaternions ? HairCacheHeader::HasQuaternions : 0;
+	mHeader.numStrands = topo.size() > 0 ? (uint32_t)(topo.size() - 1) : 0;
+	mHeader.numPoints = (uint32_t)(dof.getDoFs().size() / dof.vertexSize());
+	mHeader.topologyOffset = sizeof(HairCacheHeader);
+
+	//header is rewritten on close, once the index offset is known
+	mFile.write((const char *)&mHeader, sizeof(mHeader));
+	mFile.write((const char *)topo.data(), topo.size() * sizeof(int));
+	pad();
+
+	mIndex.clear();
+	return mFile.good();
+}
+
+bool HairCacheWriter::writeFrame(HairDoF &dof, float time) {
+	if (!mFile.is_open()) return false;
+
+	HairDoF::DoFArray &elements = dof.getDoFs();
+	auto elementSize = dof.vertexSize();
+	if (elements.size() != (Eigen::Index)mHeader.numPoints * elementSize) {
+		std::cout << "HairCacheWriter error: frame topology does not match the cache" << std::endl;
+		return false;
+	}
+
+	HairCacheFrameEntry entry;
+	entry.offset = (uint64_t)mFile.tellp();
+	entry.time = time;
+	entry.encoding = HairCacheHeader::Raw;
+
+	int nPoints = (int)mHeader.numPoints;
+
+	if (elementSize == 3) {
+		mFile.write((const char *)elements.data(), (std::streamsize)nPoints * 3 * sizeof(float));
+	}
+	else {
+		mScratch.resize((size_t)nPoints * 3);
+#pragma omp parallel for
+		for (int i = 0; i < nPoints; i++) {
+			const float *src = elements.data() + i * elementSize;
+			float *dst = mScratch.data() + i * 3;
+			dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2];
+		}
+		mFile.write((const char *)mScratch.data(), (std::streamsize)mScratch.size() * sizeof(float));
+	}
+
+	if (mHeader.flags & HairCacheHeader::HasQuaternions) {
+		pad();
+		mScratch.resize((size_t)nPoints * 4);
+#pragma omp parallel for
+		for (int i = 0; i < nPoints; i++) {
+			const float *src = elements.data() + i * elementSize + 3;
+			float *dst = mScratch.data() + i * 4;
+			dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2]; dst[3] = src[3];
+		}
+		mFile.write((const char *)mScratch.data(), (std::streamsize)mScratch.size() * sizeof(float));
+	}
+	pad();
+
+	entry.size = (uint64_t)mFile.tellp() - entry.offset;
+	mIndex.push_back(entry);
+	return mFile.good();
+}
+
+bool HairCacheWriter::writeChunk(const char *data, size_t size, const float *times, unsigned int numFrames, uint32_t encoding) {
+	if (!mFile.is_open()) return false;
+
+	HairCacheFrameEntry entry;
+	entry.offset = (uint64_t)mFile.tellp();
+	entry.size = size;
+	entry.encoding = encoding;
+
+	mFile.write(data, (std::streamsize)size);
+	pad();
+
+	for (auto i = 0u; i < numFrames; i++) {
+		entry.time = times[i];
+		mIndex.push_back(entry);
+	}
+	return mFile.good();
+}
+
+void HairCacheWriter::close() {
+	if (!mFile.is_open()) return;
+
+	mHeader.indexOffset = (uint64_t)mFile.tellp();
+	mHeader.numFrames = mIndex.size();
+	mFile.write((const char *)mIndex.data(), mIndex.size() * sizeof(HairCacheFrameEntry));
+
+	mFile.seekp(0);
+	mFile.write((const char *)&mHeader, sizeof(mHeader));
+	mFile.close();
+	mIndex.clear();
+}
+
+HairCacheReader::HairCacheReader() : mHeader(nullptr), mIndex(nullptr) {}
+
+bool HairCacheReader::open(const std::string &filename) {
+	close();
+
+	if (!mMapping.open(filename)) {
+		std::cout << "HairCacheReader error: could not map " << filename << std::endl;
+		return false;
+	}
+
+	const char *data = mMapping.data();
+	size_t size = mMapping.size();
+	const HairCacheHeader *header = (const HairCacheHeader *)data;
+
+	//sizes are checked against the file before they are multiplied or added
+	bool valid = size >= sizeof(HairCacheHeader) &&
+		std::memcmp(header->magic, sCacheMagic, sizeof(sCacheMagic)) == 0 &&
+		header->version == sCacheVersion &&
+		header->indexOffset != 0 &&
+		header->topologyOffset % sizeof(int) == 0 &&
+		header->indexOffset % sizeof(uint64_t) == 0 &&
+		header->topologyOffset <= size &&
+		header->numStrands < (size - header->topologyOffset) / sizeof(int) &&
+		header->indexOffset <= size &&
+		header->numFrames <= (size - header->indexOffset) / sizeof(HairCacheFrameEntry);
+
+	//strand offsets run from 0 to numPoints and never decrease
+	if (valid) {
+		const int *topo = (const int *)(data + header->topologyOffset);
+		valid = topo[0] == 0 && topo[header->numStrands] == (int64_t)header->numPoints;
+		for (uint32_t i = 0; valid && i < header->numStrands; i++) valid = topo[i] <= topo[i + 1];
+	}
+
+	if (!valid) {
+		std::cout << "HairCacheReader error: " << filename << " is not a complete hair cache" << std::endl;
+		mMapping.close();
+		return false;
+	}
+
+	mHeader = header;
+	mIndex = (const HairCacheFrameEntry *)(data + header->indexOffset);
+	return true;
+}
+
+void HairCacheReader::close() {
+	mMapping.close();
+	mHeader = nullptr;
+	mIndex = nullptr;
+}
+
+uint64_t HairCacheReader::quaternionOffset() const {
+	uint64_t positionBytes = (uint64_t)mHeader->numPoints * 3 * sizeof(float);
+	return (positionBytes + sCacheAlignment - 1) / sCacheAlignment * sCacheAlignment;
+}
+
+const float *HairCacheReader::frameData(unsigned int frame) const {
+	if (!mHeader || frame >= mHeader->numFrames) return nullptr;
+	const HairCacheFrameEntry &entry = mIndex[frame];
+	if (entry.encoding != HairCacheHeader::Raw || entry.offset > mMapping.size() || entry.size > mMapping.size() - entry.offset) return nullptr;
+
+	//the entry must hold the positions, and the quaternions after them
+	uint64_t frameBytes = hasQuaternions() ? quaternionOffset() + (uint64_t)mHeader->numPoints * 4 * sizeof(float) : (uint64_t)mHeader->numPoints * 3 * sizeof(float);
+	if (entry.size < frameBytes || entry.offset % sizeof(float) != 0) return nullptr;
+	return (const float *)(mMapping.data() + entry.offset);
+}
+
+float HairCacheReader::frameTime(unsigned int frame) const {
+	if (!mHeader || frame >= mHeader->numFrames) return 0;
+	return mIndex[frame].time;
+}
+
+Eigen::Map<const Eigen::VectorXi> HairCacheReader::topology() const {
+	if (!mHeader) return Eigen::Map<const Eigen::VectorXi>(nullptr, 0);
+	return Eigen::Map<const Eigen::VectorXi>((const int *)(mMapping.data() + mHeader->topologyOffset), mHeader->numStrands + 1);
+}
+
+Eigen::Map<const Eigen::Matrix3Xf> HairCacheReader::positions(unsigned int frame) const {
+	const float *data = frameData(frame);
+	if (!data) return Eigen::Map<const Eigen::Matrix3Xf>(nullptr, 3, 0);
+	return Eigen::Map<const Eigen::Matrix3Xf>(data, 3, mHeader->numPoints);
+}
+
+Eigen::Map<const Eigen::Matrix4Xf> HairCacheReader::quaternions(unsigned int frame) const {
+	const float *data = frameData(frame);
+	if (!data || !hasQuaternions()) return Eigen::Map<const Eigen::Matrix4Xf>(nullptr, 4, 0);
+
+	return Eigen::Map<const Eigen::Matrix4Xf>((const float *)((const char *)data + quaternionOffset()), 4, mHeader->numPoints);
+}
+
+bool HairCacheReader::loadFrame(unsigned int frame, HairDoF &dof) const {
+	if (!mHeader || frame >= mHeader->numFrames) return false;
+
+	auto elementSize = dof.vertexSize();
+	int nPoints = (int)mHeader->numPoints;
+
+	std::vector<float> decoded;
+	Eigen::Map<const Eigen::Matrix3Xf> pos = positions(frame);
+	Eigen::Map<const Eigen::Matrix4Xf> quats = quaternions(frame);
+
+	const HairCacheFrameEntry &entry = mIndex[frame];
+	if (entry.encoding == HairCacheHeader::DeltaChunk && entry.offset <= mMapping.size() && entry.size <= mMapping.size() - entry.offset) {
+		unsigned int firstFrame = frame;
+		while (firstFrame > 0 && mIndex[firstFrame - 1].offset == entry.offset) firstFrame--;
+
+		decoded.resize((size_t)nPoints * 7);
+		float *decodedQuats = hasQuaternions() ? decoded.data() + (size_t)nPoints * 3 : nullptr;
+		if (!HairCodec::decodeFrame(mMapping.data() + entry.offset, (size_t)entry.size, frame - firstFrame, (unsigned int)nPoints, hasQuaternions(), decoded.data(), decodedQuats))
+			return false;
+
+		new (&pos) Eigen::Map<const Eigen::Matrix3Xf>(decoded.data(), 3, nPoints);
+		if (decodedQuats) new (&quats) Eigen::Map<const Eigen::Matrix4Xf>(decodedQuats, 4, nPoints);
+	}
+	if (pos.cols() != nPoints) return false;
+
+	if (dof.getDoFs().size() != (Eigen::Index)nPoints * elementSize) {
+		Eigen::Map<const Eigen::VectorXi> topo = topology();
+		dof.setTopology((const unsigned int *)topo.data(), mHeader->numStrands);
+	}
+
+	HairDoF::DoFArray &elements = dof.getDoFs();
+	bool copyQuaternions = elementSize == 7 && quats.cols() == nPoints;
+
+#pragma omp parallel for
+	for (int i = 0; i < nPoints; i++) {
+		Eigen::Map<Eigen::Vector3f>(elements.data() + i * elementSize) = pos.col(i);
+		if (copyQuaternions) Eigen::Map<Eigen::Vector4f>(elements.data() + i * elementSize + 3) = quats.col(i);
+	}
+
+	if (elementSize == 7 && !copyQuaternions) dof.extraInitialize();
+	dof.getPrevDoFs() = elements;
+	return true;
+}
+
+void HairCacheReader::prefetch(unsigned int frame) const {
+	if (!mHeader || frame >= mHeader->numFrames) return;
+	mMapping.prefetch((size_t)mIndex[frame].offset, (size_t)mIndex[frame].size);
+}
@@ -0,0 +1,187 @@
+#include "HairCacheStream.h"
+#include "HairCodec.h"
+#include "HairSolver.h"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <cstring>
+
+typedef std::chrono::steady_clock Clock;
+
+static double secondsSince(const Clock::time_point &t) {
+	return std::chrono::duration<double>(Clock::now() - t).count();
+}
+
+HairCacheStreamWriter::HairCacheStreamWriter() : mPositionPrecision(1.0e-5f), mQuaternionPrecision(1.0e-4f), mOpen(false), mStoreQuaternions(false),
+	mChunkFrames(8), mNumPoints(0), mNextChunkId(0), mStopping(false), mNextChunkToWrite(0) {
+	std::memset(&mStats, 0, sizeof(mStats));
+}
+
+HairCacheStreamWriter::~HairCacheStreamWriter() {
+	close();
+}
+
+bool HairCacheStreamWriter::open(const std::string &filename, HairDoF &dof, bool storeQuaternions,
+	unsigned int numWorkers, unsigned int chunkFrames, unsigned int maxQueuedFrames) {
+	close();
+
+	if (!mWriter.open(filename, dof, storeQuaternions)) return false;
+
+	if (numWorkers < 1) numWorkers = 1;
+	if (chunkFrames < 1) chunkFrames = 1;
+	//a chunk needs all of its frames queued at once
+	if (maxQueuedFrames < chunkFrames) maxQueuedFrames = chunkFrames;
+
+	mStoreQuaternions = storeQuaternions;
+	mChunkFrames = chunkFrames;
+	mNumPoints = mWriter.numPoints();
+
+	mSlots.assign(maxQueuedFrames, std::vector<float>(HairCodec::frameFloats(mNumPoints, storeQuaternions)));
+	mFreeSlots.clear();
+	for (auto i = 0u; i < maxQueuedFrames; i++) mFreeSlots.push_back(maxQueuedFrames - 1 - i);
+
+	mJobs.clear();
+	mCurrent = ChunkJob();
+	mNextChunkId = 0;
+	mNextChunkToWrite = 0;
+	mPending.clear();
+	mStopping = false;
+	std::memset(&mStats, 0, sizeof(mStats));
+	mOpenTime = Clock::now();
+
+	for (auto i = 0u; i < numWorkers; i++) mWorkers.push_back(std::thread([this]() { workerLoop(); }));
+
+	mOpen = true;
+	return true;
+}
+
+bool HairCacheStreamWriter::push(HairDoF &dof, float time) {
+	if (!mOpen) return false;
+
+	HairDoF::DoFArray &elements = dof.getDoFs();
+	auto elementSize = dof.vertexSize();
+	if (elements.size() != (Eigen::Index)mNumPoints * elementSize) {
+		std::cout << "HairCacheStreamWriter error: frame topology does not match the cache" << std::endl;
+		return false;
+	}
+
+	unsigned int slot;
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		if (mFreeSlots.empty()) {
+			Clock::time_point t = Clock::now();
+			mSlotFreed.wait(lock, [this]() { return !mFreeSlots.empty(); });
+			mStats.stallSeconds += secondsSince(t);
+		}
+		slot = mFreeSlots.back();
+		mFreeSlots.pop_back();
+	}
+
+	float *dst = mSlots[slot].data();
+	int nPoints = (int)mNumPoints;
+	bool storeQuaternions = mStoreQuaternions;
+
+#pragma omp parallel for
+	for (int i = 0; i < nPoints; i++) {
+		const float *src = elements.data() + i * elementSize;
+		dst[i * 3] = src[0];
+		dst[i * 3 + 1] = src[1];
+		dst[i * 3 + 2] = src[2];
+		if (storeQuaternions) {
+			float *q = dst + nPoints * 3 + i * 4;
+			q[0] = src[3]; q[1] = src[4]; q[2] = src[5]; q[3] = src[6];
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	mCurrent.slots.push_back(slot);
+	mCurrent.times.push_back(time);
+	if (mCurrent.slots.size() >= mChunkFrames) submitChunk();
+	return true;
+}
+
+void HairCacheStreamWriter::submitChunk() {
+	if (mCurrent.slots.empty()) return;
+	mCurrent.chunkId = mNextChunkId++;
+	mJobs.push_back(std::move(mCurrent));
+	mCurrent = ChunkJob();
+	mJobReady.notify_one();
+}
+
+void HairCacheStreamWriter::workerLoop() {
+	std::vector<const float *> frames;
+
+	for (;;) {
+		ChunkJob job;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mJobReady.wait(lock, [this]() { return mStopping || !mJobs.empty(); });
+			if (mJobs.empty()) return;
+			job = std::move(mJobs.front());
+			mJobs.pop_front();
+		}
+
+		Clock::time_point t = Clock::now();
+		frames.clear();
+		for (auto slot : job.slots) frames.push_back(mSlots[slot].data());
+
+		EncodedChunk chunk;
+		HairCodec::encodeChunk(frames.data(), (unsigned int)frames.size(), mNumPoints, mStoreQuaternions, mPositionPrecision, mQuaternionPrecision, chunk.data);
+		chunk.times = std::move(job.times);
+		double encodeSeconds = secondsSince(t);
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			for (auto slot : job.slots) mFreeSlots.push_back(slot);
+		}
+		mSlotFreed.notify_all();
+
+		std::lock_guard<std::mutex> lock(mOutputMutex);
+		mStats.encodeSeconds += encodeSeconds;
+		mStats.frames += (unsigned int)chunk.times.size();
+		mStats.rawBytes += (uint64_t)chunk.times.size() * mSlots[0].size() * sizeof(float);
+		mStats.compressedBytes += chunk.data.size();
+
+		mPending[job.chunkId] = std::move(chunk);
+		for (auto it = mPending.find(mNextChunkToWrite); it != mPending.end(); it = mPending.find(mNextChunkToWrite)) {
+			EncodedChunk &next = it->second;
+			mWriter.writeChunk(next.data.data(), next.data.size(), next.times.data(), (unsigned int)next.times.size(), HairCacheHeader::DeltaChunk);
+			mPending.erase(it);
+			mNextChunkToWrite++;
+		}
+	}
+}
+
+HairCacheStreamWriter::Stats HairCacheStreamWriter::stats() {
+	std::lock_guard<std::mutex> lock(mMutex);
+	std::lock_guard<std::mutex> outputLock(mOutputMutex);
+	Stats s = mStats;
+	if (mOpen) s.wallSeconds = secondsSince(mOpenTime);
+	return s;
+}
+
+void HairCacheStreamWriter::close() {
+	if (!mOpen) return;
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		submitChunk();
+		mStopping = true;
+	}
+	mJobReady.notify_all();
+	for (auto &worker : mWorkers) worker.join();
+	mWorkers.clear();
+
+	mWriter.close();
+	mStats.wallSeconds = secondsSince(mOpenTime);
+	mOpen = false;
+	mSlots.clear();
+
+	//formatted locally, so the caller's std::cout flags stay as they were
+	std::ostringstream report;
+	report << std::fixed << std::setprecision(2)
+		<< "HairCacheStreamWriter: " << mStats.frames << " frames, "
+		<< mStats.throughputMBs() << " MB/s, ratio " << mStats.compressionRatio() << ":1, "
+		<< "encode " << mStats.encodeSeconds << " s, stalled " << mStats.stallSeconds << " s";
+	std::cout << report.str() << std::endl;
+}
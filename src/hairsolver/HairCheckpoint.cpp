@@ -0,0 +1,266 @@
+#include "HairCheckpoint.h"
+#include "HairMappedFile.h"
+#include "HairParallel.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+const char sCheckpointMagic[8] = { 'H', 'A', 'I', 'R', 'C', 'K', 'P', 'T' };
+const uint32_t sCheckpointVersion = 1;
+const uint64_t sCheckpointAlignment = 64;
+
+uint64_t alignOffset(uint64_t offset) {
+	return (offset + sCheckpointAlignment - 1) / sCheckpointAlignment * sCheckpointAlignment;
+}
+
+void writeAt(std::ofstream &file, uint64_t offset, const void *data, size_t size) {
+	static const char zeros[sCheckpointAlignment] = {};
+	uint64_t pos = (uint64_t)file.tellp();
+	if (offset > pos) file.write(zeros, (std::streamsize)(offset - pos));
+	file.write((const char *)data, (std::streamsize)size);
+}
+
+double secondsSince(const std::chrono::steady_clock::time_point &start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+//the arrays of a state in file order, with their sizes in bytes
+struct CheckpointArrays {
+	const void *data[6];
+	uint64_t offset[6];
+	size_t size[6];
+};
+
+//array offsets and file size, from the counts and vertex size of h
+void layout(HairCheckpointHeader &h) {
+	uint64_t dofBytes = sizeof(float) * (uint64_t)h.numPoints * h.vertexSize;
+	uint64_t rootBytes = sizeof(float) * (uint64_t)h.numRoots * h.vertexSize;
+	h.topologyOffset = alignOffset(sizeof(HairCheckpointHeader));
+	h.typesOffset = alignOffset(h.topologyOffset + sizeof(int) * ((uint64_t)h.numStrands + 1));
+	h.dofOffset = alignOffset(h.typesOffset + sizeof(int) * (uint64_t)h.numPoints);
+	h.dofPrevOffset = alignOffset(h.dofOffset + dofBytes);
+	h.rootsOffset = alignOffset(h.dofPrevOffset + dofBytes);
+	h.rootsPrevOffset = alignOffset(h.rootsOffset + rootBytes);
+	h.fileSize = h.rootsPrevOffset + rootBytes;
+}
+
+CheckpointArrays checkpointArrays(const HairCheckpointHeader &h, HairDoF &dof, HairDoF *roots) {
+	size_t dofBytes = sizeof(float) * (size_t)h.numPoints * h.vertexSize;
+	size_t rootBytes = sizeof(float) * (size_t)h.numRoots * h.vertexSize;
+	CheckpointArrays a = {
+		{ dof.getTopology().data(), dof.getPointType().data(), dof.getDoFs().data(), dof.getPrevDoFs().data(),
+		  roots ? roots->getDoFs().data() : nullptr, roots ? roots->getPrevDoFs().data() : nullptr },
+		{ h.topologyOffset, h.typesOffset, h.dofOffset, h.dofPrevOffset, h.rootsOffset, h.rootsPrevOffset },
+		{ sizeof(int) * (size_t)(h.numStrands + 1), sizeof(int) * (size_t)h.numPoints, dofBytes, dofBytes, rootBytes, rootBytes }
+	};
+	if (dof.getTopology().size() == 0) a.size[0] = 0;
+	return a;
+}
+
+}
+
+bool HairCheckpoint::describe(const HairModel &model, HairDoF &dof, HairDoF *roots, HairCheckpointHeader &h) {
+	HairDoF::IndexArray &topo = dof.getTopology();
+	uint32_t vtxSize = dof.vertexSize();
+	uint32_t nStrands = (uint32_t)std::max(0, (int)topo.size() - 1);
+
+	std::memset(&h, 0, sizeof(h));
+	std::memcpy(h.magic, sCheckpointMagic, sizeof(sCheckpointMagic));
+	h.version = sCheckpointVersion;
+	h.vertexSize = vtxSize;
+	h.numStrands = nStrands;
+	h.numPoints = (uint32_t)(dof.getDoFs().size() / vtxSize);
+	h.hairRadius = dof.mHairRadius;
+
+	if (roots) {
+		if (roots->vertexSize() != vtxSize || roots->getPrevDoFs().size() != roots->getDoFs().size()) {
+			std::cout << "HairCheckpoint error: roots do not match the hair" << std::endl;
+			return false;
+		}
+		h.numRoots = (uint32_t)(roots->getDoFs().size() / vtxSize);
+	}
+
+	h.timestep = model.mTimestep;
+	h.gravity = model.mGravity;
+	h.segmentLength = model.mSegmentLength;
+	h.stiffness = model.mStiffness;
+	h.rotFreq[0] = model.mRotXfreq;
+	h.rotFreq[1] = model.mRotYfreq;
+	h.rotFreq[2] = model.mRotZfreq;
+	h.rotAmp[0] = model.mRotXamp;
+	h.rotAmp[1] = model.mRotYamp;
+	h.rotAmp[2] = model.mRotZamp;
+	h.currentTime = model.mCurrentTime;
+	h.transform = model.mTransform ? 1 : 0;
+	h.deterministic = model.mDeterministic ? 1 : 0;
+	std::memcpy(h.rootRotation, model.mRootRotation.coeffs().data(), sizeof(h.rootRotation));
+	std::memcpy(h.currentRootRotation, model.mCurrentRootRotation.coeffs().data(), sizeof(h.currentRootRotation));
+
+	layout(h);
+	return true;
+}
+
+bool HairCheckpoint::save(const std::string &filename, const HairModel &model, HairDoF &dof, HairDoF *roots) {
+	HairCheckpointHeader header;
+	if (!describe(model, dof, roots, header)) return false;
+
+	std::ofstream file(filename, std::ios::out | std::ios::trunc | std::ios::binary);
+	if (!file.is_open()) {
+		std::cout << "HairCheckpoint error: could not open " << filename << std::endl;
+		return false;
+	}
+
+	CheckpointArrays arrays = checkpointArrays(header, dof, roots);
+	writeAt(file, 0, &header, sizeof(header));
+	for (int i = 0; i < 6; i++)
+		if (arrays.size[i] > 0) writeAt(file, arrays.offset[i], arrays.data[i], arrays.size[i]);
+	writeAt(file, header.fileSize, nullptr, 0);
+	return file.good();
+}
+
+bool HairCheckpoint::load(const std::string &filename, HairModel &model, HairDoF &dof, HairDoF *roots) {
+	HairMappedFile mapping;
+	if (!mapping.open(filename) || mapping.size() < sizeof(HairCheckpointHeader)) {
+		std::cout << "HairCheckpoint error: could not map " << filename << std::endl;
+		return false;
+	}
+
+	HairCheckpointHeader h;
+	std::memcpy(&h, mapping.data(), sizeof(h));
+	if (std::memcmp(h.magic, sCheckpointMagic, sizeof(sCheckpointMagic)) != 0 || h.version != sCheckpointVersion) {
+		std::cout << "HairCheckpoint error: " << filename << " is not a valid checkpoint" << std::endl;
+		return false;
+	}
+	if (h.vertexSize != dof.vertexSize() || (roots && h.numRoots > 0 && roots->vertexSize() != h.vertexSize)) {
+		std::cout << "HairCheckpoint error: checkpoint has " << h.vertexSize << " floats per point, hair has " << dof.vertexSize() << std::endl;
+		return false;
+	}
+
+	//the stored layout must be the one save() derives from the counts, and lie within the file
+	HairCheckpointHeader expected = h;
+	layout(expected);
+	CheckpointArrays arrays = checkpointArrays(h, dof, roots);
+	bool valid = expected.topologyOffset == h.topologyOffset && expected.typesOffset == h.typesOffset &&
+		expected.dofOffset == h.dofOffset && expected.dofPrevOffset == h.dofPrevOffset &&
+		expected.rootsOffset == h.rootsOffset && expected.rootsPrevOffset == h.rootsPrevOffset &&
+		expected.fileSize == h.fileSize && h.fileSize <= mapping.size();
+	for (int i = 0; valid && i < 6; i++) valid = arrays.offset[i] + arrays.size[i] <= h.fileSize;
+
+	//strand offsets run from 0 to numPoints and never decrease
+	const int *topo = (const int *)(mapping.data() + h.topologyOffset);
+	if (valid) valid = h.numPoints <= (uint32_t)INT_MAX && topo[0] == 0 && topo[h.numStrands] == (int)h.numPoints;
+	for (auto i = 0u; valid && i < h.numStrands; i++) valid = topo[i] <= topo[i + 1];
+
+	if (!valid) {
+		std::cout << "HairCheckpoint error: " << filename << " is truncated or corrupt" << std::endl;
+		return false;
+	}
+
+	mapping.prefetch(0, (size_t)h.fileSize);
+
+	dof.getTopology().resize(h.numStrands + 1);
+	dof.getPointType().resize(h.numPoints);
+	dof.getDoFs().resize((Eigen::Index)h.numPoints * h.vertexSize);
+	dof.getPrevDoFs().resize((Eigen::Index)h.numPoints * h.vertexSize);
+	dof.mHairRadius = h.hairRadius;
+	if (roots) {
+		roots->getDoFs().resize((Eigen::Index)h.numRoots * h.vertexSize);
+		roots->getPrevDoFs().resize((Eigen::Index)h.numRoots * h.vertexSize);
+	}
+
+	arrays = checkpointArrays(h, dof, roots);
+	for (int i = 0; i < 6; i++)
+		if (arrays.size[i] > 0 && arrays.data[i]) HairParallel::copy((void *)arrays.data[i], mapping.data() + arrays.offset[i], arrays.size[i]);
+
+	model.mTimestep = h.timestep;
+	model.mGravity = h.gravity;
+	model.mSegmentLength = h.segmentLength;
+	model.mStiffness = h.stiffness;
+	model.mRotXfreq = h.rotFreq[0];
+	model.mRotYfreq = h.rotFreq[1];
+	model.mRotZfreq = h.rotFreq[2];
+	model.mRotXamp = h.rotAmp[0];
+	model.mRotYamp = h.rotAmp[1];
+	model.mRotZamp = h.rotAmp[2];
+	model.mCurrentTime = h.currentTime;
+	model.mTransform = h.transform != 0;
+	model.mDeterministic = h.deterministic != 0;
+	std::memcpy(model.mRootRotation.coeffs().data(), h.rootRotation, sizeof(h.rootRotation));
+	std::memcpy(model.mCurrentRootRotation.coeffs().data(), h.currentRootRotation, sizeof(h.currentRootRotation));
+	return true;
+}
+
+HairCheckpointWriter::HairCheckpointWriter() : mCopySeconds(0), mStallSeconds(0), mWriteSeconds(0), mPending(false), mFailed(false), mStopping(false) {
+	mThread = std::thread([this]() { writerLoop(); });
+}
+
+HairCheckpointWriter::~HairCheckpointWriter() {
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		mCondition.wait(lock, [this]() { return !mPending; });
+		mStopping = true;
+	}
+	mCondition.notify_all();
+	mThread.join();
+}
+
+bool HairCheckpointWriter::snapshot(const std::string &filename, const HairModel &model, HairDoF &dof, HairDoF *roots) {
+	auto start = std::chrono::steady_clock::now();
+
+	HairCheckpointHeader header;
+	if (!HairCheckpoint::describe(model, dof, roots, header)) return false;
+
+	//the buffer is free once the previous checkpoint is written
+	std::unique_lock<std::mutex> lock(mMutex);
+	mCondition.wait(lock, [this]() { return !mPending; });
+	mStallSeconds = secondsSince(start);
+
+	mBuffer.resize((size_t)header.fileSize);
+	std::memset(mBuffer.data(), 0, (size_t)header.topologyOffset);
+	std::memcpy(mBuffer.data(), &header, sizeof(header));
+	CheckpointArrays arrays = checkpointArrays(header, dof, roots);
+	for (int i = 0; i < 6; i++)
+		if (arrays.size[i] > 0) HairParallel::copy(mBuffer.data() + arrays.offset[i], arrays.data[i], arrays.size[i]);
+
+	mFilename = filename;
+	mPending = true;
+	lock.unlock();
+	mCondition.notify_all();
+
+	mCopySeconds = secondsSince(start);
+	return true;
+}
+
+bool HairCheckpointWriter::wait() {
+	std::unique_lock<std::mutex> lock(mMutex);
+	mCondition.wait(lock, [this]() { return !mPending; });
+	return !mFailed;
+}
+
+void HairCheckpointWriter::writerLoop() {
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (true) {
+		mCondition.wait(lock, [this]() { return mPending || mStopping; });
+		if (!mPending) return;
+
+		//the solver does not touch the buffer while mPending is set
+		lock.unlock();
+		auto start = std::chrono::steady_clock::now();
+		std::ofstream file(mFilename, std::ios::out | std::ios::trunc | std::ios::binary);
+		if (file.is_open()) file.write(mBuffer.data(), (std::streamsize)mBuffer.size());
+		bool ok = file.is_open() && file.good();
+		if (!ok) std::cout << "HairCheckpointWriter error: could not write " << mFilename << std::endl;
+		double seconds = secondsSince(start);
+		lock.lock();
+
+		mWriteSeconds = seconds;
+		mFailed = !ok;
+		mPending = false;
+		mCondition.notify_all();
+	}
+}
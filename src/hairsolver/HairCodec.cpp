@@ -0,0 +1,275 @@
+#include "HairCodec.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+namespace {
+
+const int sProbBits = 11;
+const int sMoveBits = 5;
+const uint32_t sTopValue = 1u << 24;
+const double sQuantizationLimit = (double)(1 << 28);
+
+//adaptive probabilities for one value component
+struct ResidualModel {
+	uint16_t bitCount[64];
+	uint16_t topBit[33];
+
+	ResidualModel() {
+		for (auto &p : bitCount) p = 1 << (sProbBits - 1);
+		for (auto &p : topBit) p = 1 << (sProbBits - 1);
+	}
+};
+
+class RangeEncoder {
+public:
+	RangeEncoder(std::vector<char> &out) : mOut(out), mLow(0), mRange(0xFFFFFFFFu), mCache(0), mCacheSize(1) {}
+
+	void encodeBit(uint16_t &prob, uint32_t bit) {
+		uint32_t bound = (mRange >> sProbBits) * prob;
+		if (bit == 0) {
+			mRange = bound;
+			prob += ((1 << sProbBits) - prob) >> sMoveBits;
+		}
+		else {
+			mLow += bound;
+			mRange -= bound;
+			prob -= prob >> sMoveBits;
+		}
+		while (mRange < sTopValue) {
+			mRange <<= 8;
+			shiftLow();
+		}
+	}
+
+	void encodeDirect(uint32_t bit) {
+		mRange >>= 1;
+		if (bit) mLow += mRange;
+		while (mRange < sTopValue) {
+			mRange <<= 8;
+			shiftLow();
+		}
+	}
+
+	void encodeResidual(ResidualModel &model, int32_t r) {
+		uint32_t u = ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+		uint32_t nbits = 0;
+		while (nbits < 32 && (u >> nbits)) nbits++;
+
+		uint32_t m = 1;
+		for (int i = 5; i >= 0; i--) {
+			uint32_t bit = (nbits >> i) & 1;
+			encodeBit(model.bitCount[m], bit);
+			m = (m << 1) | bit;
+		}
+		if (nbits < 2) return;
+
+		encodeBit(model.topBit[nbits], (u >> (nbits - 2)) & 1);
+		for (int i = (int)nbits - 3; i >= 0; i--) encodeDirect((u >> i) & 1);
+	}
+
+	void flush() {
+		for (int i = 0; i < 5; i++) shiftLow();
+	}
+
+private:
+	void shiftLow() {
+		if ((uint32_t)mLow < 0xFF000000u || (mLow >> 32) != 0) {
+			uint8_t carry = (uint8_t)(mLow >> 32);
+			uint8_t temp = mCache;
+			do {
+				mOut.push_back((char)(uint8_t)(temp + carry));
+				temp = 0xFF;
+			} while (--mCacheSize != 0);
+			mCache = (uint8_t)(mLow >> 24);
+		}
+		mCacheSize++;
+		mLow = (mLow & 0x00FFFFFFu) << 8;
+	}
+
+	std::vector<char> &mOut;
+	uint64_t mLow;
+	uint32_t mRange;
+	uint8_t mCache;
+	uint64_t mCacheSize;
+};
+
+class RangeDecoder {
+public:
+	RangeDecoder(const char *data, size_t size) : mData((const uint8_t *)data), mSize(size), mPos(0), mRange(0xFFFFFFFFu), mCode(0) {
+		for (int i = 0; i < 5; i++) mCode = (mCode << 8) | nextByte();
+	}
+
+	uint32_t decodeBit(uint16_t &prob) {
+		uint32_t bound = (mRange >> sProbBits) * prob;
+		uint32_t bit;
+		if (mCode < bound) {
+			mRange = bound;
+			prob += ((1 << sProbBits) - prob) >> sMoveBits;
+			bit = 0;
+		}
+		else {
+			mCode -= bound;
+			mRange -= bound;
+			prob -= prob >> sMoveBits;
+			bit = 1;
+		}
+		normalize();
+		return bit;
+	}
+
+	uint32_t decodeDirect() {
+		mRange >>= 1;
+		uint32_t bit = 0;
+		if (mCode >= mRange) {
+			mCode -= mRange;
+			bit = 1;
+		}
+		normalize();
+		return bit;
+	}
+
+	int32_t decodeResidual(ResidualModel &model) {
+		uint32_t m = 1;
+		for (int i = 0; i < 6; i++) m = (m << 1) | decodeBit(model.bitCount[m]);
+		uint32_t nbits = m - 64;
+
+		uint32_t u = nbits > 0 ? 1 : 0;
+		if (nbits >= 2) {
+			u = (u << 1) | decodeBit(model.topBit[nbits > 32 ? 32 : nbits]);
+			for (int i = (int)nbits - 3; i >= 0; i--) u = (u << 1) | decodeDirect();
+		}
+		return (int32_t)((u >> 1) ^ (0u - (u & 1)));
+	}
+
+	bool overrun() const { return mPos > mSize + 4; }
+
+private:
+	uint8_t nextByte() {
+		uint8_t b = mPos < mSize ? mData[mPos] : 0;
+		mPos++;
+		return b;
+	}
+
+	void normalize() {
+		while (mRange < sTopValue) {
+			mRange <<= 8;
+			mCode = (mCode << 8) | nextByte();
+		}
+	}
+
+	const uint8_t *mData;
+	size_t mSize;
+	size_t mPos;
+	uint32_t mRange;
+	uint32_t mCode;
+};
+
+inline int32_t quantize(float v, float origin, double invStep) {
+	double q = std::floor((double)(v - origin) * invStep + 0.5);
+	q = std::max(-sQuantizationLimit, std::min(sQuantizationLimit, q));
+	return (int32_t)q;
+}
+
+inline float frameValue(const float *frame, unsigned int numPoints, unsigned int point, unsigned int component) {
+	if (component < 3) return frame[point * 3 + component];
+	return frame[numPoints * 3 + point * 4 + (component - 3)];
+}
+
+}
+
+void HairCodec::encodeChunk(const float *const *frames, unsigned int numFrames, unsigned int numPoints, bool hasQuaternions,
+	float positionStep, float quaternionStep, std::vector<char> &out) {
+
+	ChunkHeader header;
+	header.numFrames = numFrames;
+	header.numPoints = numPoints;
+	header.hasQuaternions = hasQuaternions ? 1 : 0;
+	header.positionStep = positionStep;
+	header.quaternionStep = quaternionStep;
+	for (int c = 0; c < 3; c++) header.origin[c] = 0;
+
+	if (numFrames > 0 && numPoints > 0) {
+		for (int c = 0; c < 3; c++) header.origin[c] = frames[0][c];
+		for (auto i = 1u; i < numPoints; i++)
+			for (int c = 0; c < 3; c++) header.origin[c] = std::min(header.origin[c], frames[0][i * 3 + c]);
+	}
+
+	out.clear();
+	out.resize(sizeof(ChunkHeader));
+	std::memcpy(out.data(), &header, sizeof(ChunkHeader));
+
+	const unsigned int numComponents = hasQuaternions ? 7 : 3;
+	const double invPositionStep = 1.0 / positionStep;
+	const double invQuaternionStep = 1.0 / quaternionStep;
+
+	std::vector<ResidualModel> models(2 * numComponents);
+	std::vector<int32_t> cur(numPoints * numComponents), prev1(cur.size()), prev2(cur.size());
+
+	RangeEncoder encoder(out);
+	for (auto k = 0u; k < numFrames; k++) {
+		for (auto i = 0u; i < numPoints; i++) {
+			for (auto c = 0u; c < numComponents; c++) {
+				float v = frameValue(frames[k], numPoints, i, c);
+				cur[i * numComponents + c] = c < 3 ? quantize(v, header.origin[c], invPositionStep) : quantize(v, 0.0f, invQuaternionStep);
+			}
+		}
+
+		ResidualModel *model = models.data() + (k == 0 ? 0 : numComponents);
+		for (auto idx = 0u; idx < cur.size(); idx++) {
+			int32_t pred;
+			if (k == 0) pred = idx >= numComponents ? cur[idx - numComponents] : 0;
+			else if (k == 1) pred = prev1[idx];
+			else pred = 2 * prev1[idx] - prev2[idx];
+
+			encoder.encodeResidual(model[idx % numComponents], cur[idx] - pred);
+		}
+
+		std::swap(prev2, prev1);
+		std::swap(prev1, cur);
+	}
+	encoder.flush();
+}
+
+bool HairCodec::decodeFrame(const char *chunk, size_t size, unsigned int frameInChunk, unsigned int numPoints, bool hasQuaternions, float *positions, float *quaternions) {
+	if (size < sizeof(ChunkHeader)) return false;
+
+	ChunkHeader header;
+	std::memcpy(&header, chunk, sizeof(ChunkHeader));
+	if (frameInChunk >= header.numFrames) return false;
+	//the buffers are sized by the caller, not by the chunk
+	if (header.numPoints != numPoints || header.hasQuaternions != (hasQuaternions ? 1u : 0u)) return false;
+
+	const unsigned int numComponents = header.hasQuaternions ? 7 : 3;
+
+	std::vector<ResidualModel> models(2 * numComponents);
+	std::vector<int32_t> cur(numPoints * numComponents), prev1(cur.size()), prev2(cur.size());
+
+	RangeDecoder decoder(chunk + sizeof(ChunkHeader), size - sizeof(ChunkHeader));
+	for (auto k = 0u; k <= frameInChunk; k++) {
+		ResidualModel *model = models.data() + (k == 0 ? 0 : numComponents);
+		for (auto idx = 0u; idx < cur.size(); idx++) {
+			int32_t pred;
+			if (k == 0) pred = idx >= numComponents ? cur[idx - numComponents] : 0;
+			else if (k == 1) pred = prev1[idx];
+			else pred = 2 * prev1[idx] - prev2[idx];
+
+			cur[idx] = pred + decoder.decodeResidual(model[idx % numComponents]);
+		}
+		if (decoder.overrun()) return false;
+
+		if (k < frameInChunk) {
+			std::swap(prev2, prev1);
+			std::swap(prev1, cur);
+		}
+	}
+
+	for (auto i = 0u; i < numPoints; i++) {
+		for (auto c = 0u; c < 3; c++)
+			positions[i * 3 + c] = header.origin[c] + (float)cur[i * numComponents + c] * header.positionStep;
+		if (quaternions && header.hasQuaternions)
+			for (auto c = 0u; c < 4; c++)
+				quaternions[i * 4 + c] = (float)cur[i * numComponents + 3 + c] * header.quaternionStep;
+	}
+	return true;
+}
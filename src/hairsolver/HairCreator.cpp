@@ -1,32 +1,300 @@
 #include "HairCreator.h"
+#include "HairParallel.h"
 
-#include <Eigen\Core>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 
-HairGeo HairCreator::createRadialHair(unsigned int seed, unsigned int numHairs, unsigned int numPointsPerHair, float hairLength) {
-	HairGeo geo;
-
-	if ((hairLength == 0) || (numPointsPerHair < 2) || (numHairs < 1)) return geo;
+namespace {
 
-	std::vector<unsigned int> offsets; offsets.resize(numHairs + 1, 0);
-	for (auto i = 1; i <= numHairs; i++) {
-		offsets[i] = offsets[i - 1] + numPointsPerHair;
-	}
-	
-	geo.resize(offsets);
+//straight strand from a random direction on a sphere of radius 0.1
+struct RadialStrand {
+	float segmentLength;
 
-	float segmentLength = hairLength / (numPointsPerHair - 1);
-	srand(seed);
-	for (auto strandId = 0; strandId < numHairs; strandId++) {
-		Eigen::Vector3f dir ( (float)rand() / (float)RAND_MAX, (float)rand() / (float)RAND_MAX, (float)rand() / (float)RAND_MAX );
+	void operator()(unsigned int, HairRandom::Stream &random, Eigen::Vector3f *points, unsigned int numPoints) const {
+		Eigen::Vector3f dir ( random.uniform(), random.uniform(), random.uniform() );
 		dir -= Eigen::Vector3f(0.5f, 0.5f, 0.5f);
 		dir.normalize();
 
 		Eigen::Vector3f root = dir * 0.1f;
 
-		for (auto pointId = 0; pointId < numPointsPerHair; pointId++) {
-			geo << (root + dir * (pointId * segmentLength));
+		for (auto pointId = 0u; pointId < numPoints; pointId++) {
+			points[pointId] = root + dir * (pointId * segmentLength);
+		}
+	}
+};
+
+}
+
+HairGeo HairCreator::createRadialHair(unsigned int seed, unsigned int numHairs, unsigned int numPointsPerHair, float hairLength) {
+	if ((hairLength == 0) || (numPointsPerHair < 2) || (numHairs < 1)) return HairGeo();
+
+	RadialStrand strand = { hairLength / (numPointsPerHair - 1) };
+	return generate(seed, numHairs, numPointsPerHair, strand);
+}
+
+void HairCreator::resizeRadialHair(HairGeo &geo, unsigned int seed, unsigned int numHairs, unsigned int numPointsPerHair, float hairLength) {
+	unsigned int nStrands = geo.numStrands();
+	if (numHairs <= nStrands) {
+		geo.truncate(numHairs);
+		return;
+	}
+	if ((hairLength == 0) || (numPointsPerHair < 2)) return;
+
+	RadialStrand strand = { hairLength / (numPointsPerHair - 1) };
+	append(geo, seed, std::vector<unsigned int>(numHairs - nStrands, numPointsPerHair), strand);
+}
+
+
+HairScalpParams::HairScalpParams() : seed(0), numHairs(1000), numPointsPerHair(10), hairLength(0.2f), lengthVariation(0), blueNoise(false), poissonRadius(0) {}
+
+namespace {
+
+//Vose's alias method: O(1) sampling of a discrete distribution
+class AliasTable {
+public:
+	AliasTable(const std::vector<double> &weights) {
+		unsigned int n = (unsigned int)weights.size();
+		mProb.assign(n, 1.0f);
+		mAlias.resize(n);
+		for (auto i = 0u; i < n; i++) mAlias[i] = i;
+
+		double total = 0;
+		for (auto w : weights) total += w;
+		if (total <= 0) return;
+
+		std::vector<double> scaled(n);
+		std::vector<unsigned int> small, large;
+		for (auto i = 0u; i < n; i++) {
+			scaled[i] = weights[i] * n / total;
+			if (scaled[i] < 1.0) small.push_back(i);
+			else large.push_back(i);
+		}
+		while (!small.empty() && !large.empty()) {
+			unsigned int s = small.back(); small.pop_back();
+			unsigned int l = large.back();
+			mProb[s] = (float)scaled[s];
+			mAlias[s] = l;
+			scaled[l] -= 1.0 - scaled[s];
+			if (scaled[l] < 1.0) {
+				large.pop_back();
+				small.push_back(l);
+			}
+		}
+	}
+
+	unsigned int sample(float u0, float u1) const {
+		unsigned int n = (unsigned int)mProb.size();
+		unsigned int i = (unsigned int)(u0 * n);
+		if (i >= n) i = n - 1;
+		return u1 < mProb[i] ? i : mAlias[i];
+	}
+
+private:
+	std::vector<float> mProb;
+	std::vector<unsigned int> mAlias;
+};
+
+void sampleRoot(const AliasTable &table, HairRandom::Stream &random, unsigned int &triangle, Eigen::Vector2f &barycentric) {
+	float u0 = random.uniform();
+	float u1 = random.uniform();
+	triangle = table.sample(u0, u1);
+
+	float s = std::sqrt(random.uniform());
+	float t = random.uniform();
+	barycentric = Eigen::Vector2f(s * (1 - t), s * t);
+}
+
+const int sCellBits = 21;
+const int sCellMax = (1 << sCellBits) - 1;
+
+//clamped while still a float: the cast of a larger value (or NaN, from a zero radius) is undefined
+int cellCoord(float v) {
+	return v < (float)sCellMax ? (int)v : sCellMax;
+}
+
+uint64_t cellKey(int x, int y, int z) {
+	return ((uint64_t)x << (2 * sCellBits)) | ((uint64_t)y << sCellBits) | (uint64_t)z;
+}
+
+//Poisson-disk selection among candidate points. Cells of size radius are
+//processed in 27 phases; cells of one phase are at least 3 cells apart, so they
+//never read each other's accepted points and can run in parallel. Within a cell
+//candidates are visited in index order, so the result is thread-count independent.
+std::vector<int> poissonSelect(const std::vector<Eigen::Vector3f> &candidates, float radius) {
+	int nCandidates = (int)candidates.size();
+	std::vector<int> result;
+	if (nCandidates == 0) return result;
+
+	Eigen::Vector3f lo = candidates[0];
+	for (auto &p : candidates) lo = lo.cwiseMin(p);
+
+	std::vector<std::pair<uint64_t, int> > order(nCandidates);
+#pragma omp parallel for schedule(static)
+	for (int i = 0; i < nCandidates; i++) {
+		Eigen::Vector3f c = (candidates[i] - lo) / radius;
+		int x = cellCoord(c.x());
+		int y = cellCoord(c.y());
+		int z = cellCoord(c.z());
+		order[i] = std::make_pair(cellKey(x, y, z), i);
+	}
+	std::sort(order.begin(), order.end());
+
+	std::vector<uint64_t> cellKeys;
+	std::vector<int> cellStart;
+	for (int i = 0; i < nCandidates; i++) {
+		if (cellKeys.empty() || cellKeys.back() != order[i].first) {
+			cellKeys.push_back(order[i].first);
+			cellStart.push_back(i);
 		}
 	}
-	
+	cellStart.push_back(nCandidates);
+	int nCells = (int)cellKeys.size();
+
+	std::vector<int> phaseCells[27];
+	for (int c = 0; c < nCells; c++) {
+		int x = (int)(cellKeys[c] >> (2 * sCellBits));
+		int y = (int)(cellKeys[c] >> sCellBits) & sCellMax;
+		int z = (int)cellKeys[c] & sCellMax;
+		phaseCells[(x % 3) * 9 + (y % 3) * 3 + (z % 3)].push_back(c);
+	}
+
+	std::vector<std::vector<int> > accepted(nCells);
+	const float radius2 = radius * radius;
+
+	for (int phase = 0; phase < 27; phase++) {
+		const std::vector<int> &cells = phaseCells[phase];
+		int nPhaseCells = (int)cells.size();
+
+#pragma omp parallel for schedule(dynamic, 64)
+		for (int pc = 0; pc < nPhaseCells; pc++) {
+			int cell = cells[pc];
+			int x = (int)(cellKeys[cell] >> (2 * sCellBits));
+			int y = (int)(cellKeys[cell] >> sCellBits) & sCellMax;
+			int z = (int)cellKeys[cell] & sCellMax;
+
+			std::vector<const std::vector<int> *> neighbours;
+			for (int dx = -1; dx <= 1; dx++) for (int dy = -1; dy <= 1; dy++) for (int dz = -1; dz <= 1; dz++) {
+				int nx = x + dx, ny = y + dy, nz = z + dz;
+				if (nx < 0 || ny < 0 || nz < 0 || nx > sCellMax || ny > sCellMax || nz > sCellMax) continue;
+				auto it = std::lower_bound(cellKeys.begin(), cellKeys.end(), cellKey(nx, ny, nz));
+				if (it != cellKeys.end() && *it == cellKey(nx, ny, nz)) neighbours.push_back(&accepted[it - cellKeys.begin()]);
+			}
+
+			for (int k = cellStart[cell]; k < cellStart[cell + 1]; k++) {
+				const Eigen::Vector3f &p = candidates[order[k].second];
+				bool free = true;
+				for (auto n = neighbours.begin(); free && n != neighbours.end(); ++n)
+					for (auto other : **n)
+						if ((candidates[other] - p).squaredNorm() < radius2) {
+							free = false;
+							break;
+						}
+				if (free) accepted[cell].push_back(order[k].second);
+			}
+		}
+	}
+
+	for (auto &cell : accepted) result.insert(result.end(), cell.begin(), cell.end());
+	std::sort(result.begin(), result.end());
+	return result;
+}
+
+}
+
+HairGeo HairCreator::createScalpHair(const HairScalp &scalp, const HairScalpParams &params, HairRootBinding *binding) {
+	if (binding) {
+		binding->triangles.clear();
+		binding->barycentrics.clear();
+	}
+	int nTriangles = (int)scalp.triangles.size();
+	if ((params.hairLength == 0) || (params.numPointsPerHair < 2) || (params.numHairs < 1) || (nTriangles == 0)) return HairGeo();
+
+	bool hasDensity = scalp.density.size() == scalp.vertices.size();
+	std::vector<double> weights(nTriangles);
+
+	//summed in fixed blocks so the area, and with it the Poisson radius, does not depend on the thread count
+	double coveredArea = HairParallel::orderedReduce(nTriangles, 0.0,
+		[&](int first, int end) {
+			double sum = 0;
+			for (int i = first; i < end; i++) {
+				const Eigen::Vector3i &t = scalp.triangles[i];
+				double area = 0.5 * (scalp.vertices[t[1]] - scalp.vertices[t[0]]).cross(scalp.vertices[t[2]] - scalp.vertices[t[0]]).norm();
+				double density = hasDensity ? (scalp.density[t[0]] + scalp.density[t[1]] + scalp.density[t[2]]) / 3.0 : 1.0;
+				weights[i] = area * std::max(0.0, density);
+				sum += area * std::min(1.0, std::max(0.0, density));
+			}
+			return sum;
+		},
+		[](double a, double b) { return a + b; });
+	AliasTable table(weights);
+
+	//roots are either drawn inside the strand generator (one stream per strand),
+	//or preselected from candidates by the Poisson-disk pass
+	std::vector<unsigned int> rootTriangles;
+	std::vector<Eigen::Vector2f> rootBarycentrics;
+	unsigned int numHairs = params.numHairs;
+
+	if (params.blueNoise) {
+		const int oversampling = 6;
+		int nCandidates = (int)params.numHairs * oversampling;
+		HairRandom candidateRng(params.seed | (1ull << 32));
+
+		std::vector<unsigned int> candidateTriangles(nCandidates);
+		std::vector<Eigen::Vector2f> candidateBarycentrics(nCandidates);
+		std::vector<Eigen::Vector3f> candidatePositions(nCandidates);
+
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < nCandidates; i++) {
+			HairRandom::Stream random = candidateRng.stream(i);
+			sampleRoot(table, random, candidateTriangles[i], candidateBarycentrics[i]);
+			candidatePositions[i] = scalp.position(candidateTriangles[i], candidateBarycentrics[i]);
+		}
+
+		//hexagonal packing of numHairs points over the covered area has spacing sqrt(2A / (sqrt(3) N));
+		//random sequential packing saturates well before that
+		float radius = params.poissonRadius;
+		if (radius <= 0) radius = 0.7f * (float)std::sqrt(2.0 * coveredArea / (std::sqrt(3.0) * params.numHairs));
+
+		std::vector<int> selected = poissonSelect(candidatePositions, radius);
+		if (selected.size() > params.numHairs) selected.resize(params.numHairs);
+		numHairs = (unsigned int)selected.size();
+
+		rootTriangles.resize(numHairs);
+		rootBarycentrics.resize(numHairs);
+		for (auto i = 0u; i < numHairs; i++) {
+			rootTriangles[i] = candidateTriangles[selected[i]];
+			rootBarycentrics[i] = candidateBarycentrics[selected[i]];
+		}
+	}
+	else {
+		rootTriangles.resize(numHairs);
+		rootBarycentrics.resize(numHairs);
+	}
+	if (numHairs == 0) return HairGeo();
+
+	const bool blueNoise = params.blueNoise;
+	const float hairLength = params.hairLength;
+	const float lengthVariation = params.lengthVariation;
+
+	HairGeo geo = generate(params.seed, numHairs, params.numPointsPerHair,
+		[&](unsigned int strandId, HairRandom::Stream &random, Eigen::Vector3f *points, unsigned int numPoints) {
+		if (!blueNoise) sampleRoot(table, random, rootTriangles[strandId], rootBarycentrics[strandId]);
+
+		Eigen::Vector3f root = scalp.position(rootTriangles[strandId], rootBarycentrics[strandId]);
+		Eigen::Vector3f dir = scalp.normal(rootTriangles[strandId], rootBarycentrics[strandId]);
+		float segmentLength = hairLength * (1 - lengthVariation * random.uniform()) / (numPoints - 1);
+
+		for (auto pointId = 0u; pointId < numPoints; pointId++) {
+			points[pointId] = root + dir * (pointId * segmentLength);
+		}
+	});
+
+	if (binding) {
+		binding->triangles = std::move(rootTriangles);
+		binding->barycentrics = std::move(rootBarycentrics);
+	}
 	return geo;
-}
\ No newline at end of file
+}
@@ -4,14 +4,21 @@ HairVertex::HairVertex() :pos(), t(), id(0) {}
 
 HairSegment::HairSegment():a(),b(){}
 
-HairGeo::HairGeo() : pointIter(0), strandIter(0){}
-HairGeo::HairGeo(HairGeo&&o) noexcept : pointIter(o.pointIter), strandIter(o.strandIter), offsets(std::move(o.offsets)), points(std::move(o.points)){}
+HairGeo::HairGeo() : pointIter(0), strandIter(0), mNumSegments(0), mHasEmptyStrands(false){}
+HairGeo::HairGeo(HairGeo&&o) noexcept : pointIter(o.pointIter), strandIter(o.strandIter), offsets(std::move(o.offsets)), points(std::move(o.points)), mNumSegments(o.mNumSegments), mHasEmptyStrands(o.mHasEmptyStrands){
+	o.mNumSegments = 0;
+	o.mHasEmptyStrands = false;
+}
 
 HairGeo & HairGeo::operator= (HairGeo&&o) {
 	pointIter = o.pointIter;
 	strandIter = o.strandIter;
 	offsets = std::move(o.offsets);
 	points = std::move(o.points);
+	mNumSegments = o.mNumSegments;
+	mHasEmptyStrands = o.mHasEmptyStrands;
+	o.mNumSegments = 0;
+	o.mHasEmptyStrands = false;
 	return *this;
 }
 
@@ -24,6 +31,7 @@ void HairGeo::clear() {
 	resetIter();
 	offsets.clear();
 	points.clear();
+	update();
 }
 
 void HairGeo::resetIter() {
@@ -41,7 +49,71 @@ void HairGeo::resize(std::vector<unsigned int> &offs) {
 	points.resize(numPoints, Eigen::Vector3f(0,0,0));
 
 	resetIter();
+	update();
+}
+void HairGeo::truncate(unsigned int numStrands) {
+	if (numStrands >= this->numStrands()) return;
+
+	offsets.resize(numStrands + 1);
+	points.resize(offsets[numStrands]);
+
+	resetIter();
+	update();
 }
+
+void HairGeo::resample(unsigned int pointsPerStrand, float spacing) {
+	int nStrands = (int)numStrands();
+	if (nStrands == 0) return;
+
+	std::vector<Eigen::Vector3f> resampled((size_t)nStrands * pointsPerStrand);
+
+#pragma omp parallel for schedule(static)
+	for (int i = 0; i < nStrands; i++) {
+		resampleStrand((const float *)(points.data() + offsets[i]), offsets[i + 1] - offsets[i], 3, (float *)(resampled.data() + (size_t)i * pointsPerStrand), pointsPerStrand, 3, spacing);
+	}
+
+	points.swap(resampled);
+	for (int i = 0; i <= nStrands; i++) offsets[i] = (unsigned int)i * pointsPerStrand;
+
+	resetIter();
+	update();
+}
+
+void HairGeo::resampleStrand(const float *src, unsigned int n, unsigned int srcStride, float *dst, unsigned int m, unsigned int dstStride, float spacing) {
+	typedef Eigen::Map<const Eigen::Vector3f> ConstPoint;
+	if (m == 0) return;
+	if (n < 2) {
+		Eigen::Vector3f p = n == 1 ? Eigen::Vector3f(ConstPoint(src)) : Eigen::Vector3f::Zero();
+		for (auto k = 0u; k < m; k++) Eigen::Map<Eigen::Vector3f>(dst + k * dstStride) = p;
+		return;
+	}
+
+	if (spacing <= 0) {
+		float length = 0;
+		for (auto j = 0u; j + 1 < n; j++) length += (ConstPoint(src + (j + 1) * srcStride) - ConstPoint(src + j * srcStride)).norm();
+		spacing = m > 1 ? length / (m - 1) : 0;
+	}
+
+	//walk the segments once; the last one is extended past the tip
+	unsigned int j = 0;
+	float segmentStart = 0;
+	float segmentLength = (ConstPoint(src + srcStride) - ConstPoint(src)).norm();
+	for (auto k = 0u; k < m; k++) {
+		float s = k * spacing;
+		while (j + 2 < n && s > segmentStart + segmentLength) {
+			segmentStart += segmentLength;
+			j++;
+			segmentLength = (ConstPoint(src + (j + 1) * srcStride) - ConstPoint(src + j * srcStride)).norm();
+		}
+
+		ConstPoint a(src + j * srcStride);
+		ConstPoint b(src + (j + 1) * srcStride);
+		float t = segmentLength > 0 ? (s - segmentStart) / segmentLength : 0;
+		Eigen::Map<Eigen::Vector3f> p(dst + k * dstStride);
+		p = a + (b - a) * t;
+	}
+}
+
 void HairGeo::operator<<(const Eigen::Vector3f &p) {
 	if (pointIter >= points.size()) return;
 	points[pointIter] = p;
@@ -103,15 +175,21 @@ void HairGeo::operator>>(Eigen::Vector3f &p) {
 	pointIter++;
 }
 
-unsigned int HairGeo::numSegments() const {
-	unsigned int numSegments = 0;
-	unsigned int offSize = offsets.size();
-	for (auto i = 1u; i < offSize; i++) {
-		auto nPoints = (offsets[i] - offsets[i - 1]);
-		if (nPoints>1)
-			numSegments += (nPoints-1);
+void HairGeo::update() {
+	int nStrands = (int)numStrands();
+	long long numSegments = 0;
+	int emptyStrands = 0;
+
+#pragma omp parallel for schedule(static) reduction(+:numSegments, emptyStrands)
+	for (int i = 0; i < nStrands; i++) {
+		auto nPoints = (offsets[i + 1] - offsets[i]);
+		if (nPoints > 1)
+			numSegments += (nPoints - 1);
+		if (nPoints == 0)
+			emptyStrands++;
 	}
-	return numSegments;
+	mNumSegments = (unsigned int)numSegments;
+	mHasEmptyStrands = emptyStrands > 0;
 }
 
 unsigned int HairGeo::numPoints() const {
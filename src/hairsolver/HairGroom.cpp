@@ -0,0 +1,158 @@
+#include "HairGroom.h"
+#include "HairParallel.h"
+#include <fstream>
+#include <iostream>
+#include <cstring>
+
+static const char sGroomMagic[8] = { 'H', 'A', 'I', 'R', 'G', 'R', 'O', 'M' };
+static const uint32_t sGroomVersion = 1;
+static const uint64_t sGroomAlignment = 64;
+
+static uint64_t alignOffset(uint64_t offset) {
+	return (offset + sGroomAlignment - 1) / sGroomAlignment * sGroomAlignment;
+}
+
+static void writeAt(std::ofstream &file, uint64_t offset, const void *data, size_t size) {
+	static const char zeros[sGroomAlignment] = {};
+	uint64_t pos = (uint64_t)file.tellp();
+	if (offset > pos) file.write(zeros, (std::streamsize)(offset - pos));
+	file.write((const char *)data, (std::streamsize)size);
+}
+
+HairGroomFile::HairGroomFile() : mHeader(nullptr) {}
+
+bool HairGroomFile::write(const std::string &filename, const HairGeo &geo, const std::vector<HairGroomAttribute> &attributes) {
+	auto nStrands = geo.numStrands();
+
+	for (auto &attr : attributes) {
+		if (attr.name.size() >= sizeof(HairGroomAttributeEntry::name) || attr.components == 0 ||
+			attr.values.size() != (size_t)attr.components * nStrands) {
+			std::cout << "HairGroomFile error: invalid attribute \"" << attr.name << "\"" << std::endl;
+			return false;
+		}
+	}
+
+	std::ofstream file(filename, std::ios::out | std::ios::trunc | std::ios::binary);
+	if (!file.is_open()) {
+		std::cout << "HairGroomFile error: could not open " << filename << std::endl;
+		return false;
+	}
+
+	HairGroomHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, sGroomMagic, sizeof(sGroomMagic));
+	header.version = sGroomVersion;
+	header.numStrands = nStrands;
+	header.numPoints = geo.numPoints();
+	header.numAttributes = (uint32_t)attributes.size();
+	header.offsetsOffset = alignOffset(sizeof(HairGroomHeader));
+	header.pointsOffset = alignOffset(header.offsetsOffset + (nStrands + 1ull) * sizeof(uint32_t));
+	header.attributesOffset = alignOffset(header.pointsOffset + header.numPoints * sizeof(Eigen::Vector3f));
+
+	std::vector<HairGroomAttributeEntry> entries(attributes.size());
+	uint64_t offset = header.attributesOffset + entries.size() * sizeof(HairGroomAttributeEntry);
+	for (auto i = 0u; i < attributes.size(); i++) {
+		std::memset(&entries[i], 0, sizeof(HairGroomAttributeEntry));
+		std::memcpy(entries[i].name, attributes[i].name.c_str(), attributes[i].name.size());
+		entries[i].components = attributes[i].components;
+		entries[i].offset = alignOffset(offset);
+		offset = entries[i].offset + attributes[i].values.size() * sizeof(float);
+	}
+
+	const uint32_t emptyOffsets = 0;
+	writeAt(file, 0, &header, sizeof(header));
+	if (nStrands > 0) writeAt(file, header.offsetsOffset, geo.offsets.data(), geo.offsets.size() * sizeof(uint32_t));
+	else writeAt(file, header.offsetsOffset, &emptyOffsets, sizeof(uint32_t));
+	writeAt(file, header.pointsOffset, geo.points.data(), geo.points.size() * sizeof(Eigen::Vector3f));
+	writeAt(file, header.attributesOffset, entries.data(), entries.size() * sizeof(HairGroomAttributeEntry));
+	for (auto i = 0u; i < attributes.size(); i++)
+		writeAt(file, entries[i].offset, attributes[i].values.data(), attributes[i].values.size() * sizeof(float));
+
+	return file.good();
+}
+
+bool HairGroomFile::open(const std::string &filename) {
+	close();
+
+	if (!mMapping.open(filename)) {
+		std::cout << "HairGroomFile error: could not map " << filename << std::endl;
+		return false;
+	}
+
+	const char *data = mMapping.data();
+	size_t size = mMapping.size();
+	const HairGroomHeader *header = (const HairGroomHeader *)data;
+
+	//sizes are checked against the file before they are multiplied or added
+	bool valid = size >= sizeof(HairGroomHeader) &&
+		std::memcmp(header->magic, sGroomMagic, sizeof(sGroomMagic)) == 0 &&
+		header->version == sGroomVersion &&
+		header->offsetsOffset <= size && header->numStrands < (size - header->offsetsOffset) / sizeof(uint32_t) &&
+		header->pointsOffset <= size && header->numPoints <= (size - header->pointsOffset) / sizeof(Eigen::Vector3f) &&
+		header->attributesOffset <= size && header->numAttributes <= (size - header->attributesOffset) / sizeof(HairGroomAttributeEntry);
+
+	//strand offsets run from 0 to numPoints and never decrease, so setTopology() stays in bounds
+	if (valid) {
+		const uint32_t *offs = (const uint32_t *)(data + header->offsetsOffset);
+		valid = offs[0] == 0 && offs[header->numStrands] == header->numPoints;
+		for (auto i = 0u; valid && i < header->numStrands; i++) valid = offs[i] <= offs[i + 1];
+
+		const HairGroomAttributeEntry *entries = (const HairGroomAttributeEntry *)(data + header->attributesOffset);
+		for (auto i = 0u; valid && i < header->numAttributes; i++)
+			valid = entries[i].offset <= size && (uint64_t)entries[i].components * header->numStrands <= (size - entries[i].offset) / sizeof(float);
+	}
+
+	if (!valid) {
+		std::cout << "HairGroomFile error: " << filename << " is not a valid groom" << std::endl;
+		mMapping.close();
+		return false;
+	}
+
+	mHeader = header;
+	return true;
+}
+
+void HairGroomFile::close() {
+	mMapping.close();
+	mHeader = nullptr;
+}
+
+const unsigned int *HairGroomFile::offsets() const {
+	if (!mHeader) return nullptr;
+	return (const unsigned int *)(mMapping.data() + mHeader->offsetsOffset);
+}
+
+const Eigen::Vector3f *HairGroomFile::points() const {
+	if (!mHeader) return nullptr;
+	return (const Eigen::Vector3f *)(mMapping.data() + mHeader->pointsOffset);
+}
+
+Eigen::Map<const Eigen::Matrix3Xf> HairGroomFile::pointMatrix() const {
+	if (!mHeader) return Eigen::Map<const Eigen::Matrix3Xf>(nullptr, 3, 0);
+	return Eigen::Map<const Eigen::Matrix3Xf>((const float *)points(), 3, (Eigen::Index)mHeader->numPoints);
+}
+
+Eigen::Map<const Eigen::MatrixXf> HairGroomFile::attribute(const std::string &name) const {
+	if (mHeader) {
+		const HairGroomAttributeEntry *entries = (const HairGroomAttributeEntry *)(mMapping.data() + mHeader->attributesOffset);
+		for (auto i = 0u; i < mHeader->numAttributes; i++) {
+			if (std::strncmp(entries[i].name, name.c_str(), sizeof(entries[i].name)) != 0) continue;
+			return Eigen::Map<const Eigen::MatrixXf>((const float *)(mMapping.data() + entries[i].offset), entries[i].components, mHeader->numStrands);
+		}
+	}
+	return Eigen::Map<const Eigen::MatrixXf>(nullptr, 0, 0);
+}
+
+bool HairGroomFile::load(HairGeo &geo) const {
+	if (!mHeader) return false;
+
+	geo.clear();
+	geo.offsets.resize(mHeader->numStrands + 1);
+	geo.points.resize((size_t)mHeader->numPoints);
+
+	HairParallel::copy(geo.offsets.data(), offsets(), geo.offsets.size() * sizeof(uint32_t));
+	HairParallel::copy(geo.points.data(), points(), geo.points.size() * sizeof(Eigen::Vector3f));
+	if (mHeader->numStrands == 0) geo.offsets.clear();
+	geo.update();
+	return true;
+}
@@ -0,0 +1,211 @@
+#include "HairImporter.h"
+#include "HairParallel.h"
+#include <algorithm>
+#include <climits>
+#include <fstream>
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+enum CyHairArrays {
+	HasSegments = 1,
+	HasPoints = 2,
+	HasThickness = 4,
+	HasTransparency = 8,
+	HasColor = 16
+};
+
+struct CyHairHeader {
+	char signature[4];
+	uint32_t numStrands;
+	uint32_t numPoints;
+	uint32_t arrays;
+	uint32_t defaultSegments;
+	float defaultThickness;
+	float defaultTransparency;
+	float defaultColor[3];
+	char info[88];
+};
+
+//number of elements read per chunk; bounds the extra memory of the importer
+const size_t sChunkBytes = 16 << 20;
+
+bool readAt(std::ifstream &file, uint64_t offset, void *dst, size_t bytes) {
+	file.seekg((std::streamoff)offset);
+	file.read((char *)dst, (std::streamsize)bytes);
+	return (size_t)file.gcount() == bytes;
+}
+
+//averages a per-point array of the given width into a per-strand attribute
+bool averagePerStrand(std::ifstream &file, uint64_t arrayOffset, unsigned int components, const HairGeo &geo, HairGroomAttribute &attr) {
+	int nStrands = (int)geo.numStrands();
+	attr.components = components;
+	attr.values.assign((size_t)nStrands * components, 0.0f);
+
+	const size_t pointBytes = components * sizeof(float);
+	const unsigned int chunkPoints = (unsigned int)(sChunkBytes / pointBytes);
+	std::vector<float> buffer;
+
+	int first = 0;
+	while (first < nStrands) {
+		//take whole strands until the chunk is full (at least one strand)
+		int last = first + 1;
+		while (last < nStrands && geo.offsets[last + 1] - geo.offsets[first] <= chunkPoints) last++;
+
+		unsigned int begin = geo.offsets[first];
+		unsigned int count = geo.offsets[last] - begin;
+		buffer.resize((size_t)count * components);
+		if (!readAt(file, arrayOffset + (uint64_t)begin * pointBytes, buffer.data(), buffer.size() * sizeof(float))) return false;
+
+#pragma omp parallel for schedule(static)
+		for (int s = first; s < last; s++) {
+			unsigned int n = geo.offsets[s + 1] - geo.offsets[s];
+			if (n == 0) continue;
+			const float *src = buffer.data() + (size_t)(geo.offsets[s] - begin) * components;
+			float *dst = attr.values.data() + (size_t)s * components;
+			for (auto p = 0u; p < n; p++)
+				for (auto c = 0u; c < components; c++) dst[c] += src[p * components + c];
+			for (auto c = 0u; c < components; c++) dst[c] /= (float)n;
+		}
+		first = last;
+	}
+	return true;
+}
+
+}
+
+bool HairImporter::loadCyHair(const std::string &filename, HairGeo &geo, std::vector<HairGroomAttribute> *attributes) {
+	static_assert(sizeof(CyHairHeader) == 128, "cyHair header must be 128 bytes");
+
+	std::ifstream file(filename, std::ios::in | std::ios::binary);
+	if (!file.is_open()) {
+		std::cout << "loadCyHair error: could not open " << filename << std::endl;
+		return false;
+	}
+
+	CyHairHeader header;
+	if (!readAt(file, 0, &header, sizeof(header)) || std::memcmp(header.signature, "HAIR", 4) != 0) {
+		std::cout << "loadCyHair error: " << filename << " is not a .hair file" << std::endl;
+		return false;
+	}
+	if (!(header.arrays & HasPoints)) {
+		std::cout << "loadCyHair error: " << filename << " has no points array" << std::endl;
+		return false;
+	}
+
+	//every strand has a point of 3 floats, plus its segment count if stored
+	file.seekg(0, std::ios::end);
+	uint64_t fileSize = (uint64_t)file.tellg();
+	uint64_t strandBytes = 3 * sizeof(float) + ((header.arrays & HasSegments) ? sizeof(uint16_t) : 0);
+	if (header.numStrands > (uint32_t)INT_MAX - 1 || header.numStrands * strandBytes > fileSize - sizeof(CyHairHeader)) {
+		std::cout << "loadCyHair error: " << filename << " claims " << header.numStrands << " strands, more than the file holds" << std::endl;
+		return false;
+	}
+
+	int nStrands = (int)header.numStrands;
+	uint64_t offset = sizeof(CyHairHeader);
+
+	geo.clear();
+	geo.offsets.resize(nStrands + 1);
+	geo.offsets[0] = 0;
+
+	//point counts per strand, then prefix sum into offsets
+	if (header.arrays & HasSegments) {
+		const size_t chunkStrands = sChunkBytes / sizeof(uint16_t);
+		std::vector<uint16_t> segments;
+		for (size_t first = 0; first < (size_t)nStrands; first += chunkStrands) {
+			int count = (int)std::min(chunkStrands, (size_t)nStrands - first);
+			segments.resize(count);
+			if (!readAt(file, offset + first * sizeof(uint16_t), segments.data(), count * sizeof(uint16_t))) {
+				std::cout << "loadCyHair error: truncated segments array" << std::endl;
+				geo.clear();
+				return false;
+			}
+			unsigned int *counts = geo.offsets.data() + 1 + first;
+#pragma omp parallel for schedule(static)
+			for (int i = 0; i < count; i++) counts[i] = segments[i] + 1u;
+		}
+		offset += (uint64_t)nStrands * sizeof(uint16_t);
+	}
+	else {
+		unsigned int *counts = geo.offsets.data() + 1;
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < nStrands; i++) counts[i] = header.defaultSegments + 1u;
+	}
+	HairParallel::inclusiveScan(geo.offsets.data() + 1, nStrands);
+
+	if (geo.offsets[nStrands] != header.numPoints) {
+		std::cout << "loadCyHair error: segments add up to " << geo.offsets[nStrands] << " points, header says " << header.numPoints << std::endl;
+		geo.clear();
+		return false;
+	}
+
+	//points are read straight into their final storage by one reader per thread
+	geo.points.resize(header.numPoints);
+	const uint64_t pointsOffset = offset;
+	const size_t chunkPoints = sChunkBytes / sizeof(Eigen::Vector3f);
+	int nChunks = (int)((header.numPoints + chunkPoints - 1) / chunkPoints);
+	int failures = 0;
+
+#pragma omp parallel reduction(+:failures)
+	{
+		std::ifstream reader(filename, std::ios::in | std::ios::binary);
+#pragma omp for schedule(dynamic)
+		for (int c = 0; c < nChunks; c++) {
+			size_t first = (size_t)c * chunkPoints;
+			size_t count = std::min(chunkPoints, (size_t)header.numPoints - first);
+			if (!reader.is_open() || !readAt(reader, pointsOffset + first * sizeof(Eigen::Vector3f), geo.points.data() + first, count * sizeof(Eigen::Vector3f))) failures++;
+		}
+	}
+	if (failures) {
+		std::cout << "loadCyHair error: truncated points array" << std::endl;
+		geo.clear();
+		return false;
+	}
+	offset += (uint64_t)header.numPoints * sizeof(Eigen::Vector3f);
+
+	if (nStrands == 0) geo.offsets.clear();
+	geo.update();
+
+	if (attributes) {
+		attributes->clear();
+		const uint64_t thicknessOffset = offset;
+		if (header.arrays & HasThickness) offset += (uint64_t)header.numPoints * sizeof(float);
+		if (header.arrays & HasTransparency) offset += (uint64_t)header.numPoints * sizeof(float);
+		const uint64_t colorOffset = offset;
+
+		HairGroomAttribute thickness;
+		thickness.name = "thickness";
+		if (header.arrays & HasThickness) {
+			if (!averagePerStrand(file, thicknessOffset, 1, geo, thickness)) {
+				std::cout << "loadCyHair error: truncated thickness array" << std::endl;
+				return false;
+			}
+		}
+		else {
+			thickness.components = 1;
+			thickness.values.assign(nStrands, header.defaultThickness);
+		}
+		attributes->push_back(std::move(thickness));
+
+		HairGroomAttribute color;
+		color.name = "color";
+		if (header.arrays & HasColor) {
+			if (!averagePerStrand(file, colorOffset, 3, geo, color)) {
+				std::cout << "loadCyHair error: truncated color array" << std::endl;
+				return false;
+			}
+		}
+		else {
+			color.components = 3;
+			color.values.resize((size_t)nStrands * 3);
+			for (int i = 0; i < nStrands; i++)
+				for (int c = 0; c < 3; c++) color.values[(size_t)i * 3 + c] = header.defaultColor[c];
+		}
+		attributes->push_back(std::move(color));
+	}
+
+	return true;
+}
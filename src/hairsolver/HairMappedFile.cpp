@@ -0,0 +1,105 @@
+#include "HairMappedFile.h"
+
+#if defined(_WIN32)
+#  include <windows.h>
+#else
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+
+HairMappedFile::HairMappedFile() : mData(nullptr), mSize(0), mFile(INVALID_HANDLE_VALUE), mMapping(nullptr) {}
+
+bool HairMappedFile::open(const std::string &filename) {
+	close();
+
+	mFile = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (mFile == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(mFile, &fileSize) || fileSize.QuadPart == 0) {
+		close();
+		return false;
+	}
+
+	mMapping = CreateFileMappingA(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mMapping) {
+		close();
+		return false;
+	}
+
+	mData = (const char *)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+	if (!mData) {
+		close();
+		return false;
+	}
+	mSize = (size_t)fileSize.QuadPart;
+	return true;
+}
+
+void HairMappedFile::close() {
+	if (mData) UnmapViewOfFile(mData);
+	if (mMapping) CloseHandle(mMapping);
+	if (mFile != INVALID_HANDLE_VALUE) CloseHandle(mFile);
+	mData = nullptr;
+	mSize = 0;
+	mMapping = nullptr;
+	mFile = INVALID_HANDLE_VALUE;
+}
+
+void HairMappedFile::prefetch(size_t, size_t) const {
+	//the Windows cache manager reads ahead on its own for sequential scrubbing
+}
+
+#else
+
+HairMappedFile::HairMappedFile() : mData(nullptr), mSize(0), mFd(-1) {}
+
+bool HairMappedFile::open(const std::string &filename) {
+	close();
+
+	mFd = ::open(filename.c_str(), O_RDONLY);
+	if (mFd < 0) return false;
+
+	struct stat st;
+	if (fstat(mFd, &st) != 0 || st.st_size == 0) {
+		close();
+		return false;
+	}
+
+	void *ptr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, mFd, 0);
+	if (ptr == MAP_FAILED) {
+		close();
+		return false;
+	}
+
+	mData = (const char *)ptr;
+	mSize = (size_t)st.st_size;
+	return true;
+}
+
+void HairMappedFile::close() {
+	if (mData) munmap((void *)mData, mSize);
+	if (mFd >= 0) ::close(mFd);
+	mData = nullptr;
+	mSize = 0;
+	mFd = -1;
+}
+
+void HairMappedFile::prefetch(size_t offset, size_t size) const {
+	if (!mData || offset >= mSize) return;
+	if (size > mSize - offset) size = mSize - offset;
+
+	size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	size_t begin = offset & ~(pageSize - 1);
+	madvise((void *)(mData + begin), size + (offset - begin), MADV_WILLNEED);
+}
+
+#endif
+
+HairMappedFile::~HairMappedFile() {
+	close();
+}
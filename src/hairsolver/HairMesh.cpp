@@ -0,0 +1,181 @@
+#include "HairMesh.h"
+#include "HairParallel.h"
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace {
+
+//any unit vector orthogonal to the unit vector t
+Eigen::Vector3f perpendicular(const Eigen::Vector3f &t) {
+	Eigen::Vector3f::Index axis;
+	t.cwiseAbs().minCoeff(&axis);
+	return t.cross(Eigen::Vector3f::Unit(axis)).normalized();
+}
+
+}
+
+HairMesh::HairMesh() : mType(Ribbons), mSides(6), mRadius(0.002f), mTipScale(0.2f), mCameraPosition(0, 0, 1), mOrthographic(true) {}
+
+void HairMesh::layout(HairDoF &dof) {
+	HairDoF::IndexArray &topo = dof.getTopology();
+	int nStrands = std::max(0, (int)topo.size() - 1);
+	unsigned int vpp = vertsPerPoint();
+	unsigned int ips = indicesPerSegment();
+
+	mVertexOffsets.assign(nStrands + 1, 0);
+	mIndexOffsets.assign(nStrands + 1, 0);
+
+	//counts shifted by one, so the inclusive scan gives first vertex and index
+#pragma omp parallel for schedule(static)
+	for (int i = 0; i < nStrands; i++) {
+		int n = topo[i + 1] - topo[i];
+		if (n < 2) continue;
+		mVertexOffsets[i + 1] = (unsigned int)n * vpp;
+		mIndexOffsets[i + 1] = (unsigned int)(n - 1) * ips;
+	}
+	HairParallel::inclusiveScan(mVertexOffsets.data(), nStrands + 1);
+	HairParallel::inclusiveScan(mIndexOffsets.data(), nStrands + 1);
+}
+
+bool HairMesh::build(HairDoF &dof, float *positions, float *normals, float *uvs, unsigned int *indices) const {
+	HairDoF::IndexArray &topo = dof.getTopology();
+	const float *coords = dof.getDoFs().data();
+	auto vtxSize = dof.vertexSize();
+	int nStrands = std::max(0, (int)topo.size() - 1);
+	if ((int)mVertexOffsets.size() != nStrands + 1) {
+		std::cout << "HairMesh error: layout() was done for another topology" << std::endl;
+		return false;
+	}
+
+	bool frames = vtxSize == 7;
+	bool tubes = mType == Tubes;
+	unsigned int vpp = vertsPerPoint();
+	unsigned int columns = tubes ? sides() : 1;
+
+	const unsigned int maxSides = 64;
+	if (tubes && sides() > maxSides) {
+		std::cout << "HairMesh error: tubes have at most " << maxSides << " sides" << std::endl;
+		return false;
+	}
+
+	//ring directions, the first repeated at the end
+	unsigned int nRing = std::min(sides(), maxSides);
+	float ringCos[maxSides + 1], ringSin[maxSides + 1];
+	for (auto s = 0u; s <= nRing; s++) {
+		float angle = 2.0f * (float)EIGEN_PI * (float)(s % nRing) / (float)nRing;
+		ringCos[s] = std::cos(angle);
+		ringSin[s] = std::sin(angle);
+	}
+
+#pragma omp parallel for schedule(static)
+	for (int i = 0; i < nStrands; i++) {
+		int start = topo[i];
+		int n = topo[i + 1] - start;
+		if (n < 2) continue;
+		unsigned int firstVertex = mVertexOffsets[i];
+
+		Eigen::Vector3f tangent = Eigen::Vector3f::UnitX();
+		Eigen::Vector3f side = Eigen::Vector3f::Zero();
+		for (int k = 0; k < n; k++) {
+			Eigen::Map<const Eigen::Vector3f> point(coords + (size_t)(start + k) * vtxSize);
+			Eigen::Map<const Eigen::Vector3f> prev(coords + (size_t)(start + std::max(k - 1, 0)) * vtxSize);
+			Eigen::Map<const Eigen::Vector3f> next(coords + (size_t)(start + std::min(k + 1, n - 1)) * vtxSize);
+
+			//central differences; a degenerate segment keeps the last tangent
+			Eigen::Vector3f chord = next - prev;
+			if (chord.squaredNorm() > 1e-20f) tangent = chord.normalized();
+
+			float v = (float)k / (float)(n - 1);
+			float radius = mRadius * (1.0f + (mTipScale - 1.0f) * v);
+			size_t vertex = firstVertex + (size_t)k * vpp;
+
+			if (!tubes) {
+				Eigen::Vector3f view = mOrthographic ? mCameraPosition : Eigen::Vector3f(mCameraPosition - point);
+				Eigen::Vector3f across = tangent.cross(view);
+				if (across.squaredNorm() > 1e-20f) side = across.normalized();
+				else if (side.isZero()) side = perpendicular(tangent);
+				Eigen::Vector3f normal = side.cross(tangent).normalized();
+
+				for (int s = 0; s < 2; s++) {
+					Eigen::Map<Eigen::Vector3f>(positions + 3 * (vertex + s)) = point + (s == 0 ? -radius : radius) * side;
+					if (normals) Eigen::Map<Eigen::Vector3f>(normals + 3 * (vertex + s)) = normal;
+					if (uvs) {
+						uvs[2 * (vertex + s)] = (float)s;
+						uvs[2 * (vertex + s) + 1] = v;
+					}
+				}
+				continue;
+			}
+
+			//material frame of the segment ending here (the root has the first
+			//segment's), or the last direction carried along
+			Eigen::Vector3f d1 = side;
+			if (frames) {
+				Eigen::Map<const Eigen::Quaternionf> q(coords + (size_t)(start + k) * vtxSize + 3);
+				d1 = q._transformVector(Eigen::Vector3f::UnitY());
+			}
+			d1 -= d1.dot(tangent) * tangent;
+			d1 = d1.squaredNorm() > 1e-20f ? d1.normalized() : perpendicular(tangent);
+			Eigen::Vector3f d2 = tangent.cross(d1);
+			side = d1;
+
+			for (auto s = 0u; s <= nRing; s++) {
+				Eigen::Vector3f dir = ringCos[s] * d1 + ringSin[s] * d2;
+				Eigen::Map<Eigen::Vector3f>(positions + 3 * (vertex + s)) = point + radius * dir;
+				if (normals) Eigen::Map<Eigen::Vector3f>(normals + 3 * (vertex + s)) = dir;
+				if (uvs) {
+					uvs[2 * (vertex + s)] = (float)s / (float)nRing;
+					uvs[2 * (vertex + s) + 1] = v;
+				}
+			}
+		}
+
+		//two counter-clockwise triangles per quad, facing the camera or outwards
+		unsigned int *index = indices + mIndexOffsets[i];
+		for (int k = 0; k + 1 < n; k++) {
+			for (auto s = 0u; s < columns; s++) {
+				unsigned int a = firstVertex + (unsigned int)k * vpp + s;
+				unsigned int b = a + 1;
+				unsigned int c = a + vpp;
+				unsigned int d = c + 1;
+				index[0] = a; index[1] = b; index[2] = c;
+				index[3] = b; index[4] = d; index[5] = c;
+				index += 6;
+			}
+		}
+	}
+	return true;
+}
+
+bool HairMesh::generate(HairDoF &dof) {
+	layout(dof);
+	size_t nVertices = numVertices();
+	mPositions.resize(3 * nVertices);
+	mNormals.resize(3 * nVertices);
+	mUVs.resize(2 * nVertices);
+	mIndices.resize(numIndices());
+	return build(dof, mPositions.data(), mNormals.data(), mUVs.data(), mIndices.data());
+}
+
+bool HairMesh::writeObj(std::ostream &out) const {
+	size_t nVertices = mPositions.size() / 3;
+	for (size_t i = 0; i < nVertices; i++)
+		out << "v " << mPositions[3 * i] << ' ' << mPositions[3 * i + 1] << ' ' << mPositions[3 * i + 2] << '\n';
+	for (size_t i = 0; i < nVertices; i++)
+		out << "vn " << mNormals[3 * i] << ' ' << mNormals[3 * i + 1] << ' ' << mNormals[3 * i + 2] << '\n';
+	for (size_t i = 0; i < nVertices; i++)
+		out << "vt " << mUVs[2 * i] << ' ' << mUVs[2 * i + 1] << '\n';
+
+	//OBJ indices start at 1
+	for (size_t i = 0; i + 2 < mIndices.size(); i += 3) {
+		out << 'f';
+		for (int c = 0; c < 3; c++) {
+			unsigned int v = mIndices[i + c] + 1;
+			out << ' ' << v << '/' << v << '/' << v;
+		}
+		out << '\n';
+	}
+	return out.good();
+}
@@ -0,0 +1,198 @@
+#include "HairNuma.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#if defined(_WIN32)
+#  include <windows.h>
+#elif defined(__linux__)
+#  include <pthread.h>
+#  include <sched.h>
+#endif
+
+#ifdef _OPENMP
+#  include <omp.h>
+#endif
+
+namespace {
+
+#if !defined(_WIN32)
+//parses a sysfs cpulist such as "0-15,32-47"
+std::vector<int> parseCpuList(const std::string &list) {
+	std::vector<int> cpus;
+	std::stringstream ss(list);
+	std::string range;
+	while (std::getline(ss, range, ',')) {
+		int first, last;
+		int n = std::sscanf(range.c_str(), "%d-%d", &first, &last);
+		if (n < 1) continue;
+		if (n == 1) last = first;
+		for (int c = first; c <= last; c++) cpus.push_back(c);
+	}
+	return cpus;
+}
+#endif
+
+int maxThreads() {
+#ifdef _OPENMP
+	return omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+int threadNum() {
+#ifdef _OPENMP
+	return omp_get_thread_num();
+#else
+	return 0;
+#endif
+}
+
+//threads actually running the current parallel region, which can be fewer than requested
+int teamSize() {
+#ifdef _OPENMP
+	return omp_get_num_threads();
+#else
+	return 1;
+#endif
+}
+
+//copies each thread range of array into fresh storage, touched only by the owning thread
+template <typename Array>
+void placeArray(Array &array, const HairNumaPlacement &placement, const HairDoF::IndexArray &topo, int stride) {
+	if (array.isAliased()) return;
+
+	Array placed;
+	placed.resize(array.size());
+
+#pragma omp parallel num_threads(placement.numThreads())
+	for (int r = threadNum(); r < placement.numThreads(); r += teamSize()) {
+		int first = topo[placement.firstStrand(r)] * stride;
+		int end = topo[placement.endStrand(r)] * stride;
+		std::copy(array.data() + first, array.data() + end, placed.data() + first);
+	}
+	array = std::move(placed);
+}
+
+}
+
+HairNumaTopology HairNumaTopology::detect() {
+	HairNumaTopology topology;
+
+#if defined(_WIN32)
+	ULONG highestNode = 0;
+	if (GetNumaHighestNodeNumber(&highestNode)) {
+		for (ULONG node = 0; node <= highestNode; node++) {
+			ULONGLONG mask = 0;
+			if (!GetNumaNodeProcessorMask((UCHAR)node, &mask) || mask == 0) continue;
+			std::vector<int> cpus;
+			for (int c = 0; c < 64; c++)
+				if (mask & (1ull << c)) cpus.push_back(c);
+			topology.nodeCpus.push_back(cpus);
+		}
+	}
+#else
+	for (int node = 0; ; node++) {
+		std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+		if (!in) break;
+		std::string list;
+		std::getline(in, list);
+		std::vector<int> cpus = parseCpuList(list);
+		if (!cpus.empty()) topology.nodeCpus.push_back(cpus);
+	}
+#endif
+
+	if (topology.nodeCpus.empty()) {
+		std::vector<int> cpus(std::max(1u, std::thread::hardware_concurrency()));
+		for (auto c = 0u; c < cpus.size(); c++) cpus[c] = (int)c;
+		topology.nodeCpus.push_back(cpus);
+	}
+	return topology;
+}
+
+HairNumaPlacement::HairNumaPlacement() : mTopology(HairNumaTopology::detect()), mPinThreads(true) {}
+
+void HairNumaPlacement::build(HairDoF &dof, int numThreads) {
+	if (numThreads <= 0) numThreads = maxThreads();
+
+	int totalCpus = 0;
+	for (auto &cpus : mTopology.nodeCpus) totalCpus += (int)cpus.size();
+
+	//threads per node in proportion to its CPUs, in node order
+	mThreadCpu.clear();
+	mThreadNode.clear();
+	int assigned = 0;
+	for (auto n = 0u; n < mTopology.numNodes(); n++) {
+		const std::vector<int> &cpus = mTopology.nodeCpus[n];
+		int count = n + 1 == mTopology.numNodes() ? numThreads - assigned : (int)((long long)numThreads * cpus.size() / totalCpus);
+		for (int i = 0; i < count; i++) {
+			mThreadCpu.push_back(cpus[i % cpus.size()]);
+			mThreadNode.push_back((int)n);
+		}
+		assigned += count;
+	}
+
+	//contiguous strand ranges of about equal point count
+	HairDoF::IndexArray &topo = dof.getTopology();
+	int nHairs = std::max(0, (int)topo.size() - 1);
+	int nPoints = nHairs > 0 ? topo[nHairs] : 0;
+	mStrandBegin.assign(numThreads + 1, nHairs);
+	mStrandBegin[0] = 0;
+	for (int t = 1; t < numThreads; t++) {
+		int boundary = (int)((long long)nPoints * t / numThreads);
+		int s = nHairs > 0 ? (int)(std::lower_bound(topo.data(), topo.data() + nHairs, boundary) - topo.data()) : 0;
+		mStrandBegin[t] = std::max(s, mStrandBegin[t - 1]);
+	}
+}
+
+void HairNumaPlacement::pinCurrentThread(int thread) const {
+	if (!mPinThreads) return;
+	int cpu = mThreadCpu[thread];
+#if defined(_WIN32)
+	if (cpu < 64) SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu);
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+	(void)cpu;
+#endif
+}
+
+void HairNumaPlacement::place(HairDoF &dof) const {
+	if (mStrandBegin.empty()) {
+		std::cout << "HairNumaPlacement error: build() before place()" << std::endl;
+		return;
+	}
+
+	//pin first, so that the copies below touch pages from the owning node
+#pragma omp parallel num_threads(numThreads())
+	for (int r = threadNum(); r < numThreads(); r += teamSize()) pinCurrentThread(r);
+
+	HairDoF::IndexArray &topo = dof.getTopology();
+	int vtxSize = (int)dof.vertexSize();
+	placeArray(dof.getDoFs(), *this, topo, vtxSize);
+	placeArray(dof.getPrevDoFs(), *this, topo, vtxSize);
+	placeArray(dof.getPointType(), *this, topo, 1);
+}
+
+void HairNumaPlacement::step(const HairModel &model, HairDoF &dof) const {
+	if (mStrandBegin.empty() || mStrandBegin.back() != std::max(0, (int)dof.getTopology().size() - 1)) {
+		std::cout << "HairNumaPlacement error: placement was built for a different topology" << std::endl;
+		return;
+	}
+
+	model.mArena.reset();
+
+#pragma omp parallel num_threads(numThreads())
+	for (int r = threadNum(); r < numThreads(); r += teamSize()) {
+		pinCurrentThread(r);
+		if (mStrandBegin[r] < mStrandBegin[r + 1]) model.stepStrands(dof, mStrandBegin[r], mStrandBegin[r + 1]);
+	}
+}
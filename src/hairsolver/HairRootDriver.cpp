@@ -0,0 +1,293 @@
+#include "HairRootDriver.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace {
+
+//orthonormal frame from the first edge and the normal of a triangle
+Eigen::Quaternionf triangleFrame(const Eigen::Vector3f &a, const Eigen::Vector3f &b, const Eigen::Vector3f &c) {
+	Eigen::Vector3f t = b - a;
+	Eigen::Vector3f n = t.cross(c - a);
+	if (t.squaredNorm() == 0 || n.squaredNorm() == 0) return Eigen::Quaternionf::Identity();
+	t.normalize();
+	n.normalize();
+
+	Eigen::Matrix3f m;
+	m.col(0) = t;
+	m.col(1) = n;
+	m.col(2) = t.cross(n);
+	return Eigen::Quaternionf(m);
+}
+
+//roots per block of the bone kernel, small enough for its arrays to stay in
+//L1; also how many roots ahead the scattered root writes are prefetched
+const int RootBlock = 128;
+
+//asks for the cache lines of a root ahead of its scattered write
+inline void prefetchRoot(const float *dof, const int *topo, int vtxSize, int i) {
+	const float *root = dof + topo[i] * vtxSize;
+	__builtin_prefetch(root, 1);
+	__builtin_prefetch(root + vtxSize - 1, 1);
+}
+
+//a * b on quaternion components (w last, as in Eigen)
+inline void multiply(float ax, float ay, float az, float aw, float bx, float by, float bz, float bw, float &x, float &y, float &z, float &w) {
+	x = aw * bx + bw * ax + ay * bz - az * by;
+	y = aw * by + bw * ay + az * bx - ax * bz;
+	z = aw * bz + bw * az + ax * by - ay * bx;
+	w = aw * bw - ax * bx - ay * by - az * bz;
+}
+
+//q * v * q^-1 for a unit quaternion q
+inline void rotate(float qx, float qy, float qz, float qw, float &x, float &y, float &z) {
+	float tx = 2 * (qy * z - qz * y);
+	float ty = 2 * (qz * x - qx * z);
+	float tz = 2 * (qx * y - qy * x);
+	float rx = x + qw * tx + qy * tz - qz * ty;
+	float ry = y + qw * ty + qz * tx - qx * tz;
+	float rz = z + qw * tz + qx * ty - qy * tx;
+	x = rx;
+	y = ry;
+	z = rz;
+}
+
+}
+
+HairRootDriver::HairRootDriver() : mMethod(DualQuaternion), mBoundToBones(false), mMaxInfluences(0), mMaxBone(-1) {}
+
+bool HairRootDriver::bindRoots(HairDoF &hair, size_t numBindings) {
+	HairDoF::DoFArray &dof = hair.getDoFs();
+	HairDoF::IndexArray &topo = hair.getTopology();
+	auto vtxSize = hair.vertexSize();
+	int nHairs = topo.size() - 1;
+	if (nHairs < 0) nHairs = 0;
+
+	if (numBindings != (size_t)nHairs) {
+		std::cout << "HairRootDriver error: " << numBindings << " bindings for " << nHairs << " strands" << std::endl;
+		return false;
+	}
+
+	mRestPositions.resize(nHairs, 3);
+	mRestFrames.resize(vtxSize == 7 ? nHairs : 0, 4);
+
+#pragma omp parallel for schedule(static)
+	for (int i = 0; i < nHairs; i++) {
+		const float *root = dof.data() + topo[i] * vtxSize;
+		mRestPositions.row(i) = Eigen::Map<const Eigen::RowVector3f>(root);
+		if (vtxSize == 7) mRestFrames.row(i) = Eigen::Map<const Eigen::RowVector4f>(root + 3);
+	}
+	return true;
+}
+
+bool HairRootDriver::bindToBones(HairDoF &hair, const BoneIndices &boneIndices, const BoneWeights &boneWeights) {
+	if (boneIndices.size() != boneWeights.size()) {
+		std::cout << "HairRootDriver error: bone indices and weights differ in size" << std::endl;
+		return false;
+	}
+	if (!bindRoots(hair, boneIndices.size())) return false;
+
+	int nRoots = (int)boneIndices.size();
+	int maxInfluences = 0, maxBone = -1;
+	for (int i = 0; i < nRoots; i++) {
+		int n = 0;
+		for (int k = 0; k < 4; k++) {
+			if (boneWeights[i][k] == 0 || boneIndices[i][k] < 0) continue;
+			maxBone = std::max(maxBone, boneIndices[i][k]);
+			n++;
+		}
+		maxInfluences = std::max(maxInfluences, n);
+	}
+	if (maxInfluences > 0) maxBone = std::max(maxBone, 0);
+
+	mInfluenceBones.assign((size_t)maxInfluences * nRoots, 0);
+	mInfluenceWeights.assign((size_t)maxInfluences * nRoots, 0.0f);
+#pragma omp parallel for schedule(static)
+	for (int i = 0; i < nRoots; i++) {
+		int n = 0;
+		for (int k = 0; k < 4; k++) {
+			if (boneWeights[i][k] == 0 || boneIndices[i][k] < 0) continue;
+			mInfluenceBones[(size_t)n * nRoots + i] = boneIndices[i][k];
+			mInfluenceWeights[(size_t)n * nRoots + i] = boneWeights[i][k];
+			n++;
+		}
+		for (int k = n; k < maxInfluences; k++) mInfluenceBones[(size_t)k * nRoots + i] = mInfluenceBones[i];
+	}
+
+	mBoundToBones = true;
+	mMaxInfluences = maxInfluences;
+	mMaxBone = maxBone;
+	mRootTriangles.clear();
+	mBarycentrics.clear();
+	return true;
+}
+
+bool HairRootDriver::bindToMesh(HairDoF &hair, const HairScalp &restScalp, const HairRootBinding &binding) {
+	if (binding.triangles.size() != binding.barycentrics.size()) {
+		std::cout << "HairRootDriver error: root binding triangles and barycentrics differ in size" << std::endl;
+		return false;
+	}
+	if (!bindRoots(hair, binding.triangles.size())) return false;
+
+	mTriangles = restScalp.triangles;
+	mRootTriangles = binding.triangles;
+	mBarycentrics = binding.barycentrics;
+	mBoundToBones = false;
+	mMaxInfluences = 0;
+	mMaxBone = -1;
+	mInfluenceBones.clear();
+	mInfluenceWeights.clear();
+
+	//keep roots that do not sit exactly on the surface at their offset
+	int nRoots = numRoots();
+#pragma omp parallel for schedule(static)
+	for (int i = 0; i < nRoots; i++)
+		mRestPositions.row(i) -= restScalp.position(mRootTriangles[i], mBarycentrics[i]).transpose();
+
+	int nTriangles = (int)mTriangles.size();
+	mRestTriangleFrames.resize(nTriangles);
+#pragma omp parallel for schedule(static)
+	for (int t = 0; t < nTriangles; t++) {
+		const Eigen::Vector3i &tri = mTriangles[t];
+		mRestTriangleFrames[t] = triangleFrame(restScalp.vertices[tri[0]], restScalp.vertices[tri[1]], restScalp.vertices[tri[2]]).conjugate();
+	}
+	return true;
+}
+
+void HairRootDriver::evaluateBones(const BoneTransforms &bones, HairDoF &hair) const {
+	int nRoots = numRoots();
+	if (!mBoundToBones || nRoots + 1 != hair.getTopology().size()) {
+		std::cout << "HairRootDriver error: not bound to bones of this hair" << std::endl;
+		return;
+	}
+	int nBones = (int)bones.size();
+	if (mMaxBone >= nBones) {
+		std::cout << "HairRootDriver error: roots are bound to bone " << mMaxBone << " of " << nBones << " bones" << std::endl;
+		return;
+	}
+
+	//per bone rotation and matrix or dual part (translation), shared by all roots
+	const bool dqs = mMethod == DualQuaternion;
+	mScratch.reset();
+	Eigen::Quaternionf *real = mScratch.allocate<Eigen::Quaternionf>(nBones);
+	Eigen::Matrix<float, 3, 4> *matrices = mScratch.allocate<Eigen::Matrix<float, 3, 4> >(nBones);
+	Eigen::Quaternionf *dual = mScratch.allocate<Eigen::Quaternionf>(nBones);
+	for (int b = 0; b < nBones; b++) {
+		real[b] = Eigen::Quaternionf(bones[b].rotation()).normalized();
+		matrices[b] = bones[b].matrix().topRows<3>();
+		Eigen::Vector3f t = bones[b].translation();
+		dual[b] = Eigen::Quaternionf(0, 0.5f * t.x(), 0.5f * t.y(), 0.5f * t.z()) * real[b];
+	}
+
+	float *dof = hair.getDoFs().data();
+	const int *topo = hair.getTopology().data();
+	int vtxSize = (int)hair.vertexSize();
+	const bool frames = vtxSize == 7;
+	int nBlocks = (nRoots + RootBlock - 1) / RootBlock;
+
+#pragma omp parallel for schedule(static)
+	for (int block = 0; block < nBlocks; block++) {
+		int begin = block * RootBlock;
+		int n = std::min(RootBlock, nRoots - begin);
+
+		//rotation r and dual part d (or the linear blended position) per root, one array per coefficient
+		alignas(64) float r[4][RootBlock], d[4][RootBlock], out[7][RootBlock], inv[RootBlock];
+		const int *bone = mInfluenceBones.data() + begin;
+		const float *weight = mInfluenceWeights.data() + begin;
+		const float *restX = mRestPositions.col(0).data() + begin;
+		const float *restY = mRestPositions.col(1).data() + begin;
+		const float *restZ = mRestPositions.col(2).data() + begin;
+		for (int j = 0; j < n; j++) {
+			//the roots of the next block load while this one computes
+			if (begin + RootBlock + j < nRoots) prefetchRoot(dof, topo, vtxSize, begin + RootBlock + j);
+
+			//blend in the hemisphere of the first influence
+			Eigen::Vector4f first = Eigen::Vector4f::Zero(), rj = Eigen::Vector4f::Zero(), dj = Eigen::Vector4f::Zero();
+			Eigen::Matrix<float, 3, 4> mj = Eigen::Matrix<float, 3, 4>::Zero();
+			for (int k = 0; k < mMaxInfluences; k++) {
+				int b = bone[(size_t)k * nRoots + j];
+				float w = weight[(size_t)k * nRoots + j];
+				const Eigen::Vector4f &q = real[b].coeffs();
+				if (k == 0) first = q;
+				float s = q.dot(first) < 0 ? -w : w;
+				rj += s * q;
+				if (dqs) dj += s * dual[b].coeffs();
+				else mj += w * matrices[b];
+			}
+			for (int c = 0; c < 4; c++) r[c][j] = rj[c];
+			if (dqs) for (int c = 0; c < 4; c++) d[c][j] = dj[c];
+			else for (int c = 0; c < 3; c++) out[c][j] = mj(c, 0) * restX[j] + mj(c, 1) * restY[j] + mj(c, 2) * restZ[j] + mj(c, 3);
+		}
+
+		//normalize and move the rest pose; no branches, so these loops vectorize
+		for (int j = 0; j < n; j++) {
+			float len2 = r[0][j] * r[0][j] + r[1][j] * r[1][j] + r[2][j] * r[2][j] + r[3][j] * r[3][j];
+			inv[j] = len2 > 0 ? 1 / std::sqrt(len2) : 0.0f;
+			r[0][j] *= inv[j];
+			r[1][j] *= inv[j];
+			r[2][j] *= inv[j];
+			r[3][j] = len2 > 0 ? r[3][j] * inv[j] : 1.0f;
+		}
+		if (dqs) {
+			//rotation * rest + 2 * (dual * rotation^-1).vec(); zero influences leave rest
+			for (int j = 0; j < n; j++) {
+				float x = restX[j], y = restY[j], z = restZ[j];
+				rotate(r[0][j], r[1][j], r[2][j], r[3][j], x, y, z);
+				float tx, ty, tz, tw;
+				multiply(d[0][j], d[1][j], d[2][j], d[3][j], -r[0][j], -r[1][j], -r[2][j], r[3][j], tx, ty, tz, tw);
+				out[0][j] = x + 2 * inv[j] * tx;
+				out[1][j] = y + 2 * inv[j] * ty;
+				out[2][j] = z + 2 * inv[j] * tz;
+			}
+		}
+		if (frames) {
+			const float *fx = mRestFrames.col(0).data() + begin;
+			const float *fy = mRestFrames.col(1).data() + begin;
+			const float *fz = mRestFrames.col(2).data() + begin;
+			const float *fw = mRestFrames.col(3).data() + begin;
+			for (int j = 0; j < n; j++)
+				multiply(r[0][j], r[1][j], r[2][j], r[3][j], fx[j], fy[j], fz[j], fw[j], out[3][j], out[4][j], out[5][j], out[6][j]);
+		}
+
+		for (int j = 0; j < n; j++) {
+			float *root = dof + topo[begin + j] * vtxSize;
+			for (int c = 0; c < vtxSize; c++) root[c] = out[c][j];
+		}
+	}
+}
+
+void HairRootDriver::evaluateMesh(const std::vector<Eigen::Vector3f> &deformedVertices, HairDoF &hair) const {
+	int nRoots = (int)mRootTriangles.size();
+	if (nRoots + 1 != hair.getTopology().size()) {
+		std::cout << "HairRootDriver error: not bound to a mesh for this hair" << std::endl;
+		return;
+	}
+
+	//rotation of each triangle from the rest pose
+	int nTriangles = (int)mTriangles.size();
+	mScratch.reset();
+	Eigen::Quaternionf *rotations = mScratch.allocate<Eigen::Quaternionf>(nTriangles);
+#pragma omp parallel for schedule(static)
+	for (int t = 0; t < nTriangles; t++) {
+		const Eigen::Vector3i &tri = mTriangles[t];
+		rotations[t] = triangleFrame(deformedVertices[tri[0]], deformedVertices[tri[1]], deformedVertices[tri[2]]) * mRestTriangleFrames[t];
+	}
+
+	float *dof = hair.getDoFs().data();
+	const int *topo = hair.getTopology().data();
+	int vtxSize = (int)hair.vertexSize();
+
+#pragma omp parallel for schedule(static)
+	for (int i = 0; i < nRoots; i++) {
+		if (i + RootBlock < nRoots) prefetchRoot(dof, topo, vtxSize, i + RootBlock);
+
+		unsigned int t = mRootTriangles[i];
+		const Eigen::Vector3i &tri = mTriangles[t];
+		const Eigen::Vector2f &uv = mBarycentrics[i];
+
+		float *root = dof + topo[i] * vtxSize;
+		Eigen::Map<Eigen::Vector3f> p(root);
+		p = deformedVertices[tri[0]] * (1 - uv.x() - uv.y()) + deformedVertices[tri[1]] * uv.x() + deformedVertices[tri[2]] * uv.y() + rotations[t] * Eigen::Vector3f(mRestPositions.row(i));
+		if (vtxSize == 7) Eigen::Map<Eigen::Quaternionf>(root + 3) = rotations[t] * Eigen::Quaternionf(mRestFrames.row(i).transpose());
+	}
+}
@@ -0,0 +1,33 @@
+#include "HairScalp.h"
+#include <Eigen/Geometry>
+
+Eigen::Vector3f HairScalp::position(unsigned int triangle, const Eigen::Vector2f &barycentric) const {
+	const Eigen::Vector3i &t = triangles[triangle];
+	return vertices[t[0]] * (1 - barycentric.x() - barycentric.y()) + vertices[t[1]] * barycentric.x() + vertices[t[2]] * barycentric.y();
+}
+
+Eigen::Vector3f HairScalp::normal(unsigned int triangle, const Eigen::Vector2f &barycentric) const {
+	const Eigen::Vector3i &t = triangles[triangle];
+	Eigen::Vector3f n;
+	if (mVertexNormals.size() == vertices.size())
+		n = mVertexNormals[t[0]] * (1 - barycentric.x() - barycentric.y()) + mVertexNormals[t[1]] * barycentric.x() + mVertexNormals[t[2]] * barycentric.y();
+	else
+		n = (vertices[t[1]] - vertices[t[0]]).cross(vertices[t[2]] - vertices[t[0]]);
+
+	float len = n.norm();
+	return len > 0 ? Eigen::Vector3f(n / len) : Eigen::Vector3f::UnitY();
+}
+
+void HairScalp::update() {
+	mVertexNormals.assign(vertices.size(), Eigen::Vector3f::Zero());
+
+	//serial, so that the summation order (and the normals) never change
+	for (auto &t : triangles) {
+		Eigen::Vector3f n = (vertices[t[1]] - vertices[t[0]]).cross(vertices[t[2]] - vertices[t[0]]);
+		for (int k = 0; k < 3; k++) mVertexNormals[t[k]] += n;
+	}
+	for (auto &n : mVertexNormals) {
+		float len = n.norm();
+		if (len > 0) n /= len;
+	}
+}
@@ -0,0 +1,134 @@
+#include "HairSharedMemory.h"
+
+#if defined(_WIN32)
+#  include <windows.h>
+#else
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+
+HairSharedMemory::HairSharedMemory() : mData(nullptr), mSize(0), mOwner(false), mMapping(nullptr) {}
+
+bool HairSharedMemory::create(const std::string &name, size_t size) {
+	close();
+
+	unsigned long long size64 = size;
+	mMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, (DWORD)(size64 >> 32), (DWORD)size64, ("Local\\" + name).c_str());
+	if (!mMapping || GetLastError() == ERROR_ALREADY_EXISTS) {
+		close();
+		return false;
+	}
+
+	mData = (char *)MapViewOfFile(mMapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+	if (!mData) {
+		close();
+		return false;
+	}
+	mSize = size;
+	mName = name;
+	mOwner = true;
+	return true;
+}
+
+bool HairSharedMemory::open(const std::string &name) {
+	close();
+
+	mMapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, ("Local\\" + name).c_str());
+	if (!mMapping) return false;
+
+	mData = (char *)MapViewOfFile(mMapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+	if (!mData) {
+		close();
+		return false;
+	}
+
+	MEMORY_BASIC_INFORMATION info;
+	VirtualQuery(mData, &info, sizeof(info));
+	mSize = info.RegionSize;
+	mName = name;
+	mOwner = false;
+	return true;
+}
+
+void HairSharedMemory::close() {
+	if (mData) UnmapViewOfFile(mData);
+	if (mMapping) CloseHandle(mMapping);
+	mData = nullptr;
+	mMapping = nullptr;
+	mSize = 0;
+	mName.clear();
+	mOwner = false;
+}
+
+#else
+
+HairSharedMemory::HairSharedMemory() : mData(nullptr), mSize(0), mOwner(false) {}
+
+bool HairSharedMemory::create(const std::string &name, size_t size) {
+	close();
+
+	std::string path = "/" + name;
+	int fd = shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0) return false;
+
+	if (ftruncate(fd, (off_t)size) != 0) {
+		::close(fd);
+		shm_unlink(path.c_str());
+		return false;
+	}
+
+	void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (p == MAP_FAILED) {
+		shm_unlink(path.c_str());
+		return false;
+	}
+
+	mData = (char *)p;
+	mSize = size;
+	mName = name;
+	mOwner = true;
+	return true;
+}
+
+bool HairSharedMemory::open(const std::string &name) {
+	close();
+
+	int fd = shm_open(("/" + name).c_str(), O_RDWR, 0600);
+	if (fd < 0) return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+
+	void *p = mmap(nullptr, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (p == MAP_FAILED) return false;
+
+	mData = (char *)p;
+	mSize = (size_t)st.st_size;
+	mName = name;
+	mOwner = false;
+	return true;
+}
+
+void HairSharedMemory::close() {
+	if (mData) munmap(mData, mSize);
+	if (mOwner) shm_unlink(("/" + mName).c_str());
+	mData = nullptr;
+	mSize = 0;
+	mName.clear();
+	mOwner = false;
+}
+
+#endif
+
+HairSharedMemory::~HairSharedMemory() {
+	close();
+}
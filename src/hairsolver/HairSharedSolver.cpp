@@ -0,0 +1,286 @@
+#include "HairSharedSolver.h"
+#include "HairParallel.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <thread>
+
+#if defined(_WIN32)
+#  include <windows.h>
+#else
+#  include <spawn.h>
+#  include <sys/wait.h>
+#  include <unistd.h>
+extern char **environ;
+#endif
+
+namespace {
+
+const char sSharedMagic[8] = { 'H', 'A', 'I', 'R', 'S', 'H', 'M', '1' };
+const uint32_t sSharedVersion = 2;
+
+uint64_t align64(uint64_t v) { return (v + 63) & ~(uint64_t)63; }
+
+template <typename T>
+T *segmentArray(HairSharedMemory &segment, uint64_t offset) {
+	return (T *)(segment.data() + offset);
+}
+
+//spins briefly, then yields, then sleeps, so idle workers do not burn a core
+template <typename Done>
+bool waitUntil(Done done, std::atomic<uint32_t> &stop) {
+	for (unsigned int spin = 0; !done(); spin++) {
+		if (stop.load(std::memory_order_acquire)) return false;
+		if (spin < 1000) continue;
+		if (spin < 10000) std::this_thread::yield();
+		else std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
+	return true;
+}
+
+void aliasDoF(HairDoF &dof, const std::shared_ptr<HairSharedMemory> &segment, const HairSharedHeader &h) {
+	Eigen::Index n = (Eigen::Index)h.numPoints * h.vertexSize;
+	dof.getTopology().alias(segmentArray<int>(*segment, h.topologyOffset), h.numStrands + 1, segment);
+	dof.getPointType().alias(segmentArray<int>(*segment, h.typesOffset), h.numPoints, segment);
+	dof.getDoFs().alias(segmentArray<float>(*segment, h.dofOffset), n, segment);
+	dof.getPrevDoFs().alias(segmentArray<float>(*segment, h.dofPrevOffset), n, segment);
+	dof.mHairRadius = h.hairRadius;
+}
+
+}
+
+HairSharedSolver::HairSharedSolver() : mHeader(nullptr), mStep(0) {}
+
+HairSharedSolver::~HairSharedSolver() {
+	shutdown();
+}
+
+bool HairSharedSolver::create(const std::string &name, HairDoF &dof, const HairModel &model, unsigned int numWorkers) {
+	shutdown();
+
+	HairDoF::IndexArray &topo = dof.getTopology();
+	uint32_t nStrands = (uint32_t)std::max(0, (int)topo.size() - 1);
+	uint32_t nPoints = nStrands > 0 ? (uint32_t)topo[nStrands] : 0;
+	uint32_t vtxSize = dof.vertexSize();
+	if (numWorkers == 0 || nStrands == 0) {
+		std::cout << "HairSharedSolver error: need at least one worker and one strand" << std::endl;
+		return false;
+	}
+
+	HairSharedHeader layout;
+	layout.strandBeginOffset = align64(sizeof(HairSharedHeader));
+	layout.topologyOffset = align64(layout.strandBeginOffset + sizeof(uint32_t) * (numWorkers + 1));
+	layout.typesOffset = align64(layout.topologyOffset + sizeof(int) * (nStrands + 1));
+	layout.dofOffset = align64(layout.typesOffset + sizeof(int) * (uint64_t)nPoints);
+	layout.dofPrevOffset = align64(layout.dofOffset + sizeof(float) * (uint64_t)nPoints * vtxSize);
+	layout.rootsOffset = align64(layout.dofPrevOffset + sizeof(float) * (uint64_t)nPoints * vtxSize);
+	uint64_t size = align64(layout.rootsOffset + sizeof(float) * (uint64_t)nStrands * vtxSize);
+
+	mSegment = std::make_shared<HairSharedMemory>();
+	if (!mSegment->create(name, (size_t)size)) {
+		std::cout << "HairSharedSolver error: cannot create shared memory " << name << std::endl;
+		mSegment.reset();
+		return false;
+	}
+
+	HairSharedHeader *h = new (mSegment->data()) HairSharedHeader();
+	std::memcpy(h->magic, sSharedMagic, sizeof(sSharedMagic));
+	h->version = sSharedVersion;
+	h->numWorkers = numWorkers;
+	h->numStrands = nStrands;
+	h->numPoints = nPoints;
+	h->vertexSize = vtxSize;
+	const HairModel_PBD_Cosserat *cosserat = dynamic_cast<const HairModel_PBD_Cosserat *>(&model);
+	h->modelType = cosserat ? PBD_Cosserat : FollowTheLeader;
+	h->timestep = model.mTimestep;
+	h->gravity = model.mGravity;
+	h->segmentLength = model.mSegmentLength;
+	h->stiffness = model.mStiffness;
+	h->hairRadius = dof.mHairRadius;
+	h->tolerance = cosserat ? cosserat->mTolerance : 0;
+	h->relativeTolerance = cosserat ? cosserat->mRelativeTolerance : 0;
+	h->minIterations = cosserat ? cosserat->mMinIterations : 1;
+	h->strandBeginOffset = layout.strandBeginOffset;
+	h->topologyOffset = layout.topologyOffset;
+	h->typesOffset = layout.typesOffset;
+	h->dofOffset = layout.dofOffset;
+	h->dofPrevOffset = layout.dofPrevOffset;
+	h->rootsOffset = layout.rootsOffset;
+
+	//contiguous partitions of about equal point count
+	uint32_t *strandBegin = segmentArray<uint32_t>(*mSegment, h->strandBeginOffset);
+	strandBegin[0] = 0;
+	strandBegin[numWorkers] = nStrands;
+	for (auto w = 1u; w < numWorkers; w++) {
+		int boundary = (int)((uint64_t)nPoints * w / numWorkers);
+		uint32_t s = (uint32_t)(std::lower_bound(topo.data(), topo.data() + nStrands, boundary) - topo.data());
+		strandBegin[w] = std::max(s, strandBegin[w - 1]);
+	}
+
+	HairParallel::copy(segmentArray<char>(*mSegment, h->topologyOffset), topo.data(), sizeof(int) * (nStrands + 1));
+	HairParallel::copy(segmentArray<char>(*mSegment, h->typesOffset), dof.getPointType().data(), sizeof(int) * (size_t)nPoints);
+	HairParallel::copy(segmentArray<char>(*mSegment, h->dofOffset), dof.getDoFs().data(), sizeof(float) * (size_t)nPoints * vtxSize);
+	HairParallel::copy(segmentArray<char>(*mSegment, h->dofPrevOffset), dof.getPrevDoFs().data(), sizeof(float) * (size_t)nPoints * vtxSize);
+
+	//from here on the caller's DoF is a live view of the segment
+	aliasDoF(dof, mSegment, *h);
+
+	mHeader = h;
+	mStep = 0;
+	return true;
+}
+
+bool HairSharedSolver::launchWorkers(const std::string &executable, const std::string &workerFlag) {
+	if (!mHeader) return false;
+
+	for (auto w = 0u; w < mHeader->numWorkers; w++) {
+		std::string index = std::to_string(w);
+#if defined(_WIN32)
+		std::string commandLine = "\"" + executable + "\" " + workerFlag + " " + mSegment->name() + " " + index;
+		STARTUPINFOA si;
+		PROCESS_INFORMATION pi;
+		ZeroMemory(&si, sizeof(si));
+		si.cb = sizeof(si);
+		if (!CreateProcessA(executable.c_str(), &commandLine[0], nullptr, nullptr, FALSE, 0, nullptr, nullptr, &si, &pi)) {
+			std::cout << "HairSharedSolver error: cannot launch worker " << w << std::endl;
+			shutdown();
+			return false;
+		}
+		CloseHandle(pi.hThread);
+		mWorkers.push_back((intptr_t)pi.hProcess);
+#else
+		std::string name = mSegment->name();
+		char *argv[] = { (char *)executable.c_str(), (char *)workerFlag.c_str(), (char *)name.c_str(), (char *)index.c_str(), nullptr };
+		pid_t pid;
+		if (posix_spawn(&pid, executable.c_str(), nullptr, nullptr, argv, environ) != 0) {
+			std::cout << "HairSharedSolver error: cannot launch worker " << w << std::endl;
+			shutdown();
+			return false;
+		}
+		mWorkers.push_back((intptr_t)pid);
+#endif
+	}
+	return true;
+}
+
+bool HairSharedSolver::workersAlive() {
+	for (auto &w : mWorkers) {
+#if defined(_WIN32)
+		if (WaitForSingleObject((HANDLE)w, 0) == WAIT_OBJECT_0) return false;
+#else
+		int status;
+		if (waitpid((pid_t)w, &status, WNOHANG) != 0) return false;
+#endif
+	}
+	return true;
+}
+
+bool HairSharedSolver::step(HairDoF &roots) {
+	if (!mHeader) return false;
+
+	uint32_t vtxSize = mHeader->vertexSize;
+	if (roots.vertexSize() != vtxSize || roots.getDoFs().size() != (Eigen::Index)mHeader->numStrands * vtxSize) {
+		std::cout << "HairSharedSolver error: roots do not match the shared groom" << std::endl;
+		return false;
+	}
+	HairParallel::copy(segmentArray<char>(*mSegment, mHeader->rootsOffset), roots.getDoFs().data(), sizeof(float) * (size_t)roots.getDoFs().size());
+
+	mStep++;
+	mHeader->stepRequested.store(mStep, std::memory_order_release);
+
+	uint32_t target = mHeader->numWorkers * mStep;
+	auto lastCheck = std::chrono::steady_clock::now();
+	bool alive = true;
+	waitUntil([&]() {
+		if (mHeader->stepsDone.load(std::memory_order_acquire) >= target) return true;
+		auto now = std::chrono::steady_clock::now();
+		if (now - lastCheck > std::chrono::milliseconds(100)) {
+			lastCheck = now;
+			alive = workersAlive();
+		}
+		return !alive;
+	}, mHeader->stop);
+
+	if (!alive) {
+		std::cout << "HairSharedSolver error: a worker exited during step " << mStep << std::endl;
+		shutdown();
+		return false;
+	}
+	return true;
+}
+
+void HairSharedSolver::waitForWorkers() {
+	for (auto &w : mWorkers) {
+#if defined(_WIN32)
+		WaitForSingleObject((HANDLE)w, INFINITE);
+		CloseHandle((HANDLE)w);
+#else
+		int status;
+		waitpid((pid_t)w, &status, 0);
+#endif
+	}
+	mWorkers.clear();
+}
+
+void HairSharedSolver::shutdown() {
+	if (mHeader) mHeader->stop.store(1, std::memory_order_release);
+	waitForWorkers();
+	mHeader = nullptr;
+	mSegment.reset();
+}
+
+int HairSharedSolver::runWorker(const std::string &name, unsigned int index) {
+	std::shared_ptr<HairSharedMemory> segment = std::make_shared<HairSharedMemory>();
+	if (!segment->open(name) || segment->size() < sizeof(HairSharedHeader)) {
+		std::cout << "HairSharedSolver error: cannot open shared memory " << name << std::endl;
+		return 1;
+	}
+
+	HairSharedHeader *h = (HairSharedHeader *)segment->data();
+	if (std::memcmp(h->magic, sSharedMagic, sizeof(sSharedMagic)) != 0 || h->version != sSharedVersion || index >= h->numWorkers) {
+		std::cout << "HairSharedSolver error: invalid segment or worker index" << std::endl;
+		return 1;
+	}
+
+	std::unique_ptr<HairDoF> dof;
+	if (h->vertexSize == 7) dof.reset(new HairDoF_PointsAndQuaternions());
+	else dof.reset(new HairDoF_Points());
+	aliasDoF(*dof, segment, *h);
+
+	std::unique_ptr<HairModel> model;
+	if (h->modelType == PBD_Cosserat) {
+		HairModel_PBD_Cosserat *cosserat = new HairModel_PBD_Cosserat();
+		cosserat->mTolerance = h->tolerance;
+		cosserat->mRelativeTolerance = h->relativeTolerance;
+		cosserat->mMinIterations = h->minIterations;
+		model.reset(cosserat);
+	}
+	else model.reset(new HairModel_FollowTheLeader());
+	model->mTimestep = h->timestep;
+	model->mGravity = h->gravity;
+	model->mSegmentLength = h->segmentLength;
+	model->mStiffness = h->stiffness;
+
+	const uint32_t *strandBegin = segmentArray<uint32_t>(*segment, h->strandBeginOffset);
+	int first = (int)strandBegin[index];
+	int end = (int)strandBegin[index + 1];
+	const int *topo = dof->getTopology().data();
+	const float *roots = segmentArray<float>(*segment, h->rootsOffset);
+	float *dofData = dof->getDoFs().data();
+	uint32_t vtxSize = h->vertexSize;
+
+	h->workersAttached.fetch_add(1);
+
+	for (uint32_t step = 1; ; step++) {
+		if (!waitUntil([&]() { return h->stepRequested.load(std::memory_order_acquire) >= step; }, h->stop)) break;
+
+		for (int i = first; i < end; i++)
+			std::memcpy(dofData + topo[i] * vtxSize, roots + (size_t)i * vtxSize, sizeof(float) * vtxSize);
+		if (first < end) model->stepStrands(*dof, first, end);
+
+		h->stepsDone.fetch_add(1, std::memory_order_release);
+	}
+	return 0;
+}
@@ -1,5 +1,10 @@
 #include "HairSolver.h"
+#include "HairParallel.h"
+#include <algorithm>
 #include <iostream>
+#include <new>
+#include <cstring>
+#include <cstdint>
 
 void collide(Eigen::Map<Eigen::Vector3f> &p) {
 	if (p.norm() < 0.1) {
@@ -9,45 +14,261 @@ void collide(Eigen::Map<Eigen::Vector3f> &p) {
 }
 HairDoF::HairDoF() : mHairRadius(1.0f){}
 
-HairDoF & HairDoF::operator= (const HairGeo&o) {
-	auto nPs = o.numPoints();
-	auto nStrands = o.numStrands();
-	Eigen::VectorXf& dof = getDoFs();
-	Eigen::VectorXf& dofprev = getPrevDoFs();
+void HairDoF::setTopology(const unsigned int *offsets, unsigned int nStrands) {
+	auto nPs = nStrands > 0 ? offsets[nStrands] : 0u;
+	DoFArray& dof = getDoFs();
+	DoFArray& dofprev = getPrevDoFs();
 	auto vtxSize = vertexSize();
-	Eigen::VectorXi& topo = getTopology();
-	Eigen::VectorXi& type = getPointType();
+	IndexArray& topo = getTopology();
 
 	dof.resize(nPs * vtxSize);
 	dofprev.resize(nPs * vtxSize);
-	type.resize(nPs);
 	topo.resize(nStrands + 1);
 
-	type.fill(1);
+	int n = (int)nStrands;
+#pragma omp parallel for schedule(static)
+	for (int i = 0; i <= n; i++)
+		topo[i] = n > 0 ? offsets[i] : 0;
+
+	initPointTypes();
+}
 
-	for (auto i = 0u; i <= nStrands; i++) {
-		auto off = o.offsets[i];
-		topo[i] = off;
-		if (i != nStrands) type[off] = 0;
-		if (i != 0) type[off - 1] = 2;
+void HairDoF::initPointTypes() {
+	IndexArray& topo = getTopology();
+	int nStrands = topo.size() - 1;
+	if (nStrands < 0) nStrands = 0;
+
+	getPointType().resize(nStrands > 0 ? topo[nStrands] : 0);
+	initPointTypes(0, nStrands);
+}
+
+void HairDoF::initPointTypes(int firstStrand, int endStrand) {
+	IndexArray& topo = getTopology();
+	IndexArray& type = getPointType();
+
+	//per strand: root 0, interior 1, tip 2 (a single point strand is a root, it has no segment to solve)
+#pragma omp parallel for schedule(static)
+	for (int i = firstStrand; i < endStrand; i++) {
+		int start = topo[i];
+		int end = topo[i + 1];
+		if (start == end) continue;
+		type[start] = 0;
+		for (int p = start + 1; p < end - 1; p++) type[p] = 1;
+		if (end - start > 1) type[end - 1] = 2;
 	}
+}
+
+void HairDoF::extraInitialize() {
+	int nStrands = getTopology().size() - 1;
+	if (nStrands > 0) extraInitialize(0, nStrands);
+}
 
-	for (auto i = 0u; i < nPs; i++) {
-		Eigen::Map<Eigen::Vector3f>(dof.data() + i * vtxSize) = o.points[i];
+HairDoF & HairDoF::operator= (const HairGeo&o) {
+	assign(o.offsets.data(), o.numStrands(), o.points.data());
+	return *this;
+}
+
+void HairDoF::assign(const unsigned int *offsets, unsigned int numStrands, const Eigen::Vector3f *points) {
+	DoFArray& dof = getDoFs();
+	DoFArray& dofprev = getPrevDoFs();
+	auto vtxSize = vertexSize();
+
+	setTopology(offsets, numStrands);
+	int nPs = (int)(dof.size() / vtxSize);
+
+	if (vtxSize == 3) {
+		HairParallel::copy(dof.data(), points, (size_t)nPs * sizeof(Eigen::Vector3f));
+	}
+	else {
+#pragma omp parallel for
+		for (int i = 0; i < nPs; i++) {
+			Eigen::Map<Eigen::Vector3f>(dof.data() + i * vtxSize) = points[i];
+		}
 	}
 
 	extraInitialize();
 
-	dofprev = dof;
+	HairParallel::copy(dofprev.data(), dof.data(), (size_t)dof.size() * sizeof(float));
+}
+
+HairDoF & HairDoF::adopt(HairGeo &&o) {
+	if (vertexSize() != 3 || o.offsets.empty()) {
+		assign(o.offsets.data(), o.numStrands(), o.points.data());
+		o.clear();
+		return *this;
+	}
+
+	//the DoFs keep the moved groom alive; offsets are reinterpreted as int
+	std::shared_ptr<HairGeo> geo = std::make_shared<HairGeo>(std::move(o));
+	o.clear();
+	auto nStrands = geo->numStrands();
+	auto nPs = geo->offsets[nStrands];
+
+	mDof.alias((float *)geo->points.data(), (Eigen::Index)nPs * 3, geo);
+	mTopology.alias((int *)geo->offsets.data(), nStrands + 1, geo);
+	mDofPrev.resize(mDof.size());
+	initPointTypes();
+
+	extraInitialize();
 
+	HairParallel::copy(mDofPrev.data(), mDof.data(), (size_t)mDof.size() * sizeof(float));
 	return *this;
 }
 
+bool HairDoF::resizeStrands(const HairGeo &groom, const Eigen::Quaternionf &rotation) {
+	IndexArray& topo = getTopology();
+	int oldStrands = std::max(0, (int)topo.size() - 1);
+	int newStrands = (int)groom.numStrands();
+	int keptStrands = std::min(oldStrands, newStrands);
+	if (keptStrands > 0 && topo[keptStrands] != (int)groom.offsets[keptStrands]) {
+		std::cout << "resizeStrands error: the kept strands do not match the groom" << std::endl;
+		return false;
+	}
+	if (newStrands == oldStrands) return true;
+
+	auto vtxSize = vertexSize();
+	int oldPoints = oldStrands > 0 ? topo[oldStrands] : 0;
+	int newPoints = newStrands > 0 ? (int)groom.offsets[newStrands] : 0;
+
+	topo.conservativeResize(newStrands + 1);
+	mPointType.conservativeResize(newPoints);
+	mDof.conservativeResize((Eigen::Index)newPoints * vtxSize);
+	mDofPrev.conservativeResize((Eigen::Index)newPoints * vtxSize);
+	topo[0] = 0;
+	if (newStrands < oldStrands) return true;
+
+	for (int i = oldStrands + 1; i <= newStrands; i++) topo[i] = (int)groom.offsets[i];
+	initPointTypes(oldStrands, newStrands);
+
+	float *dof = mDof.data();
+	const Eigen::Vector3f *points = groom.points.data();
+#pragma omp parallel for schedule(static)
+	for (int i = oldPoints; i < newPoints; i++) {
+		Eigen::Map<Eigen::Vector3f> p(dof + (size_t)i * vtxSize);
+		p = points[i];
+	}
+
+	extraInitialize(oldStrands, newStrands);
+
+	//frames are built at rest, then turned with the points
+	if (!rotation.coeffs().isApprox(Eigen::Quaternionf::Identity().coeffs())) {
+		Eigen::Matrix3f rotMatrix = rotation.toRotationMatrix();
+#pragma omp parallel for schedule(static)
+		for (int i = oldPoints; i < newPoints; i++) {
+			Eigen::Map<Eigen::Vector3f> p(dof + (size_t)i * vtxSize);
+			p = rotMatrix * p;
+			if (vtxSize == 7) {
+				Eigen::Map<Eigen::Quaternionf> q(dof + (size_t)i * vtxSize + 3);
+				q = rotation * q;
+			}
+		}
+	}
+
+	HairParallel::copy(mDofPrev.data() + (size_t)oldPoints * vtxSize, dof + (size_t)oldPoints * vtxSize, sizeof(float) * (size_t)(newPoints - oldPoints) * vtxSize);
+	return true;
+}
+
+void HairDoF::resample(unsigned int pointsPerStrand, float spacing) {
+	IndexArray& topo = getTopology();
+	int nStrands = topo.size() - 1;
+	if (nStrands <= 0) return;
+
+	auto vtxSize = vertexSize();
+	DoFArray dof, dofPrev;
+	dof.resize((Eigen::Index)nStrands * pointsPerStrand * vtxSize);
+	dofPrev.resize(dof.size());
+
+	//prev points follow the same arc length, so each point keeps its velocity
+#pragma omp parallel for schedule(static)
+	for (int i = 0; i < nStrands; i++) {
+		unsigned int n = topo[i + 1] - topo[i];
+		size_t src = (size_t)topo[i] * vtxSize;
+		size_t dst = (size_t)i * pointsPerStrand * vtxSize;
+		HairGeo::resampleStrand(mDof.data() + src, n, vtxSize, dof.data() + dst, pointsPerStrand, vtxSize, spacing);
+		HairGeo::resampleStrand(mDofPrev.data() + src, n, vtxSize, dofPrev.data() + dst, pointsPerStrand, vtxSize, spacing);
+	}
+
+	mDof = std::move(dof);
+	mDofPrev = std::move(dofPrev);
+	for (int i = 0; i <= nStrands; i++) topo[i] = i * (int)pointsPerStrand;
+	initPointTypes();
+
+	extraInitialize();
+
+	if (vtxSize > 3) {
+		int nPs = nStrands * (int)pointsPerStrand;
+		float *dst = mDofPrev.data();
+		const float *src = mDof.data();
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < nPs; i++) {
+			for (auto j = 3u; j < vtxSize; j++) dst[(size_t)i * vtxSize + j] = src[(size_t)i * vtxSize + j];
+		}
+	}
+}
+
+void HairDoF::resizeRootsFromHair(HairDoF &hair, const Eigen::Quaternionf &rotation) {
+	auto elementSize = hair.vertexSize();
+	if (elementSize != vertexSize()) {
+		std::cout << "resizeRootsFromHair error: elementSize incompatible" << std::endl;
+		return;
+	}
+
+	IndexArray &srcTopo = hair.getTopology();
+	int newRoots = std::max(0, (int)srcTopo.size() - 1);
+	int oldRoots = (int)(getDoFs().size() / elementSize);
+
+	mDof.conservativeResize((Eigen::Index)newRoots * elementSize);
+	mDofPrev.conservativeResize(mDof.size());
+
+	//prev roots are the rest roots that updateRoots turns
+	Eigen::Quaternionf inverse = rotation.conjugate();
+	Eigen::Matrix3f inverseMatrix = inverse.toRotationMatrix();
+	const float *src = hair.getDoFs().data();
+#pragma omp parallel for schedule(static)
+	for (int i = oldRoots; i < newRoots; i++) {
+		const float *root = src + (size_t)srcTopo[i] * elementSize;
+		float *dst = mDof.data() + (size_t)i * elementSize;
+		for (auto j = 0u; j < elementSize; j++) dst[j] = root[j];
+
+		Eigen::Map<Eigen::Vector3f> prev(mDofPrev.data() + (size_t)i * elementSize);
+		prev = inverseMatrix * Eigen::Map<const Eigen::Vector3f>(root);
+		if (elementSize == 7) {
+			Eigen::Map<Eigen::Quaternionf> prevq(mDofPrev.data() + (size_t)i * elementSize + 3);
+			prevq = inverse * Eigen::Map<const Eigen::Quaternionf>(root + 3);
+		}
+	}
+}
+
+unsigned long long HairDoF::stateHash() {
+	const unsigned long long fnvOffset = 14695981039346656037ull;
+	const unsigned long long fnvPrime = 1099511628211ull;
+
+	DoFArray& dof = getDoFs();
+	IndexArray& topo = getTopology();
+	auto vtxSize = vertexSize();
+	int nHairs = topo.size() - 1;
+	if (nHairs < 0) nHairs = 0;
+
+	return HairParallel::orderedReduce(nHairs, fnvOffset,
+		[&](int firstHair, int endHair) {
+			unsigned long long h = fnvOffset;
+			const float *begin = dof.data() + topo[firstHair] * vtxSize;
+			const float *end = dof.data() + topo[endHair] * vtxSize;
+			for (const float *v = begin; v < end; v++) {
+				uint32_t bits;
+				std::memcpy(&bits, v, sizeof(bits));
+				h = (h ^ bits) * fnvPrime;
+			}
+			return h;
+		},
+		[=](unsigned long long a, unsigned long long b) { return (a ^ b) * fnvPrime; });
+}
+
 void HairDoF::rotateFromPrev(Eigen::Quaternionf &rot) {
 	Eigen::Matrix3f rotMatrix = rot.toRotationMatrix();
 
-	Eigen::VectorXf &elements = getDoFs();
-	Eigen::VectorXf &prevElements = getPrevDoFs();
+	DoFArray &elements = getDoFs();
+	DoFArray &prevElements = getPrevDoFs();
 	auto elementSize = vertexSize();
 
 	int nElements = elements.size()/ elementSize;
@@ -73,26 +294,28 @@ void HairDoF::copyRootsFromHair(HairDoF &src) {
 		return;
 	}
 
-	Eigen::VectorXf &srcElements = src.getDoFs();
-	Eigen::VectorXi &srcTopo = src.getTopology();
+	DoFArray &srcElements = src.getDoFs();
+	IndexArray &srcTopo = src.getTopology();
 
 	int nHairs = srcTopo.size() - 1;
 
 	if (nHairs < 0) nHairs = 0;
 
-	Eigen::VectorXf &dstElements = getDoFs();
+	DoFArray &dstElements = getDoFs();
 	dstElements.resize(nHairs * elementSize);
 
+#pragma omp parallel for schedule(static)
 	for (int i = 0; i < nHairs; i++) {
 		float * src = (srcElements.data() + srcTopo[i] * elementSize);
 		float * dst = (dstElements.data() + i * elementSize);
-		for (auto j = 0; j < elementSize; j++)
+		for (auto j = 0u; j < elementSize; j++)
 			dst[j] = src[j];
 	}
 
 
-	Eigen::VectorXf &prevDstElements = getPrevDoFs();
-	prevDstElements = dstElements;
+	DoFArray &prevDstElements = getPrevDoFs();
+	prevDstElements.resize(dstElements.size());
+	HairParallel::copy(prevDstElements.data(), dstElements.data(), (size_t)dstElements.size() * sizeof(float));
 }
 
 void HairDoF::copyRootsToHair(HairDoF &dst) {
@@ -102,19 +325,20 @@ void HairDoF::copyRootsToHair(HairDoF &dst) {
 		return;
 	}
 
-	Eigen::VectorXf &dstElements = dst.getDoFs();
-	Eigen::VectorXi &dstTopo = dst.getTopology();
+	DoFArray &dstElements = dst.getDoFs();
+	IndexArray &dstTopo = dst.getTopology();
 
 	int nHairs = dstTopo.size() - 1;
 
 	if (nHairs < 0) nHairs = 0;
 
-	Eigen::VectorXf &srcElements = getDoFs();
+	DoFArray &srcElements = getDoFs();
 
+#pragma omp parallel for schedule(static)
 	for (int i = 0; i < nHairs; i++) {
 		float * dst = (dstElements.data() + dstTopo[i] * elementSize);
 		float * src = (srcElements.data() + i * elementSize);
-		for (auto j = 0; j < elementSize; j++)
+		for (auto j = 0u; j < elementSize; j++)
 			dst[j] = src[j];
 	}
 }
@@ -128,16 +352,21 @@ HairDoF_PointsAndQuaternions & HairDoF_PointsAndQuaternions::operator= (const Ha
 
 unsigned int HairDoF_PointsAndQuaternions::vertexSize() const { return 7; }
 
-void HairDoF_PointsAndQuaternions::extraInitialize() {
-	Eigen::VectorXf& dof = getDoFs();
+void HairDoF_PointsAndQuaternions::extraInitialize(int firstStrand, int endStrand) {
+	DoFArray& dof = getDoFs();
 	auto vtxSize = vertexSize();
-	Eigen::VectorXi& topo = getTopology();
-	auto nStrands = topo.size() - 1;
+	IndexArray& topo = getTopology();
 
-	for (auto hid = 0u; hid < nStrands; hid++) {
+#pragma omp parallel for schedule(static)
+	for (int hid = firstStrand; hid < endStrand; hid++) {
 		//initialize quaternions
 		auto start = topo[hid];
 		auto end = topo[hid + 1];
+		if (end - start < 2) {
+			//a single point has no segment to orient by, but its frame is still integrated and hashed
+			if (end - start == 1) Eigen::Map<Eigen::Quaternionf>(dof.data() + start * vtxSize + 3) = Eigen::Quaternionf::Identity();
+			continue;
+		}
 
 		for (auto pid = start; pid < end-1; pid++) {
 			Eigen::Map<Eigen::Vector3f> a(dof.data() + pid * vtxSize);
@@ -151,12 +380,23 @@ void HairDoF_PointsAndQuaternions::extraInitialize() {
 		Eigen::Map<Eigen::Quaternionf>(dof.data() + start * vtxSize + 3) = Eigen::Map<Eigen::Quaternionf>(dof.data() + (start + 1) * vtxSize + 3);
 	}
 }
-void HairDoF_PointsAndQuaternions::advance(float timestep, float gravity) {
-	Eigen::VectorXi &types = getPointType();
-	Eigen::VectorXf& dof = getDoFs();
-	Eigen::VectorXf& dofprev = getPrevDoFs();
+void HairDoF::advance(float timestep, float gravity) {
+	int nPoints = getPointType().size();
+	int nBlocks = (nPoints + AdvanceBlockSize - 1) / AdvanceBlockSize;
+
+#pragma omp parallel for
+	for (int b = 0; b < nBlocks; b++) {
+		HairHeapGuard guard("HairDoF::advance");
+		int end = (b + 1) * AdvanceBlockSize;
+		advance(timestep, gravity, b * AdvanceBlockSize, end < nPoints ? end : nPoints);
+	}
+}
+
+void HairDoF_PointsAndQuaternions::advance(float timestep, float gravity, int firstPoint, int endPoint) {
+	IndexArray &types = getPointType();
+	DoFArray& dof = getDoFs();
+	DoFArray& dofprev = getPrevDoFs();
 	auto vtxSize = vertexSize();
-	int nPoints = dof.size() / vtxSize;
 
 	Eigen::Vector3f accel(0, gravity, 0);
 
@@ -168,8 +408,7 @@ void HairDoF_PointsAndQuaternions::advance(float timestep, float gravity) {
 	I(2, 2) = 2* inertia;
 	Eigen::Matrix3f Iinv = I.inverse();
 
-#pragma omp parallel for
-	for (int pid = 0; pid < nPoints; pid++) {
+	for (int pid = firstPoint; pid < endPoint; pid++) {
 		if (types[pid] == 0) continue;
 		////////////////
 		//update positions
@@ -217,18 +456,15 @@ HairDoF_Points & HairDoF_Points::operator= (const HairGeo&o) {
 
 unsigned int HairDoF_Points::vertexSize() const { return 3; }
 
-void HairDoF_Points::advance(float timestep, float gravity) {
-	Eigen::VectorXi &types = getPointType();
-	Eigen::VectorXf& dof = getDoFs();
-	Eigen::VectorXf& dofprev = getPrevDoFs();
+void HairDoF_Points::advance(float timestep, float gravity, int firstPoint, int endPoint) {
+	IndexArray &types = getPointType();
+	DoFArray& dof = getDoFs();
+	DoFArray& dofprev = getPrevDoFs();
 	auto vtxSize = vertexSize();
 
-	int nPoints = dof.size() / vtxSize;
-
 	Eigen::Vector3f accel(0, gravity, 0);
 
-#pragma omp parallel for
-	for (int pid = 0; pid < nPoints; pid++) {
+	for (int pid = firstPoint; pid < endPoint; pid++) {
 		if (types[pid] != 0) {
 			Eigen::Map<Eigen::Vector3f> pNow(dof.data() + pid * vtxSize);
 			Eigen::Map<Eigen::Vector3f> pPrev(dofprev.data() + pid * vtxSize);
@@ -264,26 +500,45 @@ void HairModel::updateRoots(HairDoF &roots) {
 }
 
 
-HairModel::HairModel() : mTimestep(0.005f), mGravity(-9.81f), mSegmentLength(0.02f), mStiffness(0), mRotXfreq(0), mRotYfreq(0), mRotZfreq(0), mRotXamp(0), mRotYamp(0), mRotZamp(0), mCurrentTime(0) {}
+HairModel::HairModel() : mTimestep(0.005f), mGravity(-9.81f), mSegmentLength(0.02f), mStiffness(0), mRotXfreq(0), mRotYfreq(0), mRotZfreq(0), mRotXamp(0), mRotYamp(0), mRotZamp(0), mCurrentTime(0), mDeterministic(false), mRootRotation(1, 0, 0, 0), mCurrentRootRotation(1, 0, 0, 0) {}
 
 void HairModel::step(HairDoF &hair) const {	
+	mArena.reset();
+	HairHeapGuard guard("HairModel::step");
 	hair.advance(mTimestep, mGravity);
 	solve(hair);
 }
 
+void HairModel::stepStrands(HairDoF &hair, int firstStrand, int endStrand) const {
+	HairHeapGuard guard("HairModel::stepStrands");
+	HairDoF::IndexArray& topo = hair.getTopology();
+	hair.advance(mTimestep, mGravity, topo[firstStrand], topo[endStrand]);
+	solveStrands(hair, firstStrand, endStrand);
+}
+
 HairModel_FollowTheLeader::HairModel_FollowTheLeader() : HairModel() {}
 
 void HairModel_FollowTheLeader::solve(HairDoF &dof) const {
-	Eigen::VectorXf& coords = dof.getDoFs();
-	Eigen::VectorXf& coordsPrev = dof.getPrevDoFs();
-	Eigen::VectorXi& topo = dof.getTopology();
-	auto vertexSize = dof.vertexSize();
+	HairDoF::IndexArray& topo = dof.getTopology();
 
 	int nHairs = topo.size();
 	nHairs--;
 
-#pragma omp parallel for
-	for (int hid = 0; hid < nHairs; hid++) {
+#pragma omp parallel
+	{
+		HairHeapGuard guard("HairModel_FollowTheLeader::solve");
+#pragma omp for
+		for (int hid = 0; hid < nHairs; hid++) solveStrands(dof, hid, hid + 1);
+	}
+}
+
+void HairModel_FollowTheLeader::solveStrands(HairDoF &dof, int firstStrand, int endStrand) const {
+	HairDoF::DoFArray& coords = dof.getDoFs();
+	HairDoF::DoFArray& coordsPrev = dof.getPrevDoFs();
+	HairDoF::IndexArray& topo = dof.getTopology();
+	auto vertexSize = dof.vertexSize();
+
+	for (int hid = firstStrand; hid < endStrand; hid++) {
 		int start = topo[hid];
 		int end = topo[hid + 1];
 
@@ -309,12 +564,20 @@ void HairModel_FollowTheLeader::solve(HairDoF &dof) const {
 	}
 }
 
-HairModel_PBD_Cosserat::HairModel_PBD_Cosserat() : HairModel() {}
+HairModel_PBD_Cosserat::HairModel_PBD_Cosserat() : HairModel(), mTolerance(0), mRelativeTolerance(0), mMinIterations(1) {}
+
+bool HairModel_PBD_Cosserat::isConverged(const HairResidual &residual, const HairResidual &initial, unsigned int iteration) const {
+	if (iteration < mMinIterations) return false;
+	//a residual is met within mTolerance, or at mRelativeTolerance of its first iteration
+	bool relative = mRelativeTolerance > 0 && iteration > 1;
+	auto met = [&](float r, float r0) { return (mTolerance > 0 && r <= mTolerance) || (relative && r <= mRelativeTolerance * r0); };
+	return met(residual.stretchShear, initial.stretchShear) && met(residual.bendTwist, initial.bendTwist);
+}
 
-void HairModel_PBD_Cosserat::solveStrand(HairDoF &dof, unsigned int pid, float gammaScale, float quaternionDisplacementScale, float twistBendFactor) const {
+void HairModel_PBD_Cosserat::solveStrand(HairDoF &dof, unsigned int pid, float gammaScale, float quaternionDisplacementScale, float twistBendFactor, HairResidual *residual) const {
 
-	Eigen::VectorXi& type = dof.getPointType();
-	Eigen::VectorXf& coords = dof.getDoFs();
+	HairDoF::IndexArray& type = dof.getPointType();
+	HairDoF::DoFArray& coords = dof.getDoFs();
 	auto vertexSize = dof.vertexSize();
 
 	if (type[pid] == 0) return;
@@ -338,6 +601,13 @@ void HairModel_PBD_Cosserat::solveStrand(HairDoF &dof, unsigned int pid, float g
 	Eigen::Quaternionf quatDisp = Eigen::Quaternionf(0.0f, stretchShearStrain.x(), stretchShearStrain.y(), stretchShearStrain.z()) * qB * Eigen::Quaternionf(0,-1,0,0);
 
 	Eigen::Quaternionf darboux = (qA.conjugate() * qB);
+	if (residual) {
+		HairResidual r;
+		r.stretchShear = stretchShearStrain.norm();
+		r.bendTwist = darboux.vec().norm();
+		residual->add(r);
+	}
+
 	Eigen::Quaternionf omega(0, darboux.x()* twistBendFactor, darboux.y()* twistBendFactor, darboux.z()* twistBendFactor);
 
 	Eigen::Quaternionf qBdisp = qA * omega;
@@ -354,35 +624,148 @@ void HairModel_PBD_Cosserat::solveStrand(HairDoF &dof, unsigned int pid, float g
 	qB.normalize();
 }
 
-void HairModel_PBD_Cosserat::solve(HairDoF &dof) const {
-	Eigen::VectorXf& coords = dof.getDoFs();
-	Eigen::VectorXf& coordsPrev = dof.getPrevDoFs();
-	Eigen::VectorXi& topo = dof.getTopology();
-	Eigen::VectorXi& type = dof.getPointType();
-	auto vertexSize = dof.vertexSize();
-
-	int nHairs = topo.size();
-	nHairs--;
-	int nPoints = topo[nHairs];
-
+void HairModel_PBD_Cosserat::solverScales(const HairDoF &dof, float &gammaScale, float &quaternionDisplacementScale, float &twistBendFactor) const {
 	const float hairDensity = 0.0013f;
 	const float radius = dof.mHairRadius;
 	const float pointVolume = (mSegmentLength * EIGEN_PI * radius * radius);
 	const float pointMass = pointVolume * hairDensity;
-	const float invPointMass = 1.0f / pointMass;
 	const float segmentInertia = EIGEN_PI * radius * radius * radius * radius * 0.25f;
 	const float invSegmentInertia = 1.0f / segmentInertia;
-	const float gammaScale = pointMass / ((2 * pointMass / mSegmentLength) + 4 * mSegmentLength * invSegmentInertia  + 1.0e-6f);
-	const float quaternionDisplacementScale = 2 * invSegmentInertia * mSegmentLength;//(mSegmentLength * mSegmentLength * invSegmentInertia) / (invPointMass + invPointMass + 4 * invSegmentInertia * mSegmentLength * mSegmentLength);
+	gammaScale = pointMass / ((2 * pointMass / mSegmentLength) + 4 * mSegmentLength * invSegmentInertia  + 1.0e-6f);
+	quaternionDisplacementScale = 2 * invSegmentInertia * mSegmentLength;//(mSegmentLength * mSegmentLength * invSegmentInertia) / (invPointMass + invPointMass + 4 * invSegmentInertia * mSegmentLength * mSegmentLength);
 	
 	const float twistBendStiffness = 1.0f;
-	const float twistBendFactor = twistBendStiffness / (2* invSegmentInertia + 1.0e-6f);
+	twistBendFactor = twistBendStiffness / (2* invSegmentInertia + 1.0e-6f);
+}
+
+void HairModel_PBD_Cosserat::solve(HairDoF &dof) const {
+	HairDoF::IndexArray& topo = dof.getTopology();
+
+	int nHairs = topo.size();
+	nHairs--;
+	int nPoints = topo[nHairs];
+
+	float gammaScale, quaternionDisplacementScale, twistBendFactor;
+	solverScales(dof, gammaScale, quaternionDisplacementScale, twistBendFactor);
+
+	if (isAdaptive()) {
+		solveAdaptive(dof, gammaScale, quaternionDisplacementScale, twistBendFactor);
+		return;
+	}
+	mStats = HairSolverStats();
+	mStats.strands = nHairs;
+	mStats.iterations = (unsigned long long)nHairs * mStiffness;
+	mStats.maxIterations = mStiffness;
+
+	if (mDeterministic) {
+		solveDeterministic(dof, gammaScale, quaternionDisplacementScale, twistBendFactor);
+		return;
+	}
 
 	for (auto iter = 0; iter < mStiffness; iter++) {
-#pragma omp parallel for
-		for (int pid = 0; pid < nPoints; pid += 2) solveStrand(dof, pid, gammaScale, quaternionDisplacementScale, twistBendFactor);
+#pragma omp parallel
+		{
+			HairHeapGuard guard("HairModel_PBD_Cosserat::solve");
+#pragma omp for
+			for (int pid = 0; pid < nPoints; pid += 2) solveStrand(dof, pid, gammaScale, quaternionDisplacementScale, twistBendFactor);
+
+#pragma omp for
+			for (int pid = 1; pid < nPoints; pid += 2) solveStrand(dof, pid, gammaScale, quaternionDisplacementScale, twistBendFactor);
+		}
+	}
+}
 
-#pragma omp parallel for
-		for (int pid = 1; pid < nPoints; pid += 2) solveStrand(dof, pid, gammaScale, quaternionDisplacementScale, twistBendFactor);
+void HairModel_PBD_Cosserat::solveStrands(HairDoF &dof, int firstStrand, int endStrand) const {
+	float gammaScale, quaternionDisplacementScale, twistBendFactor;
+	solverScales(dof, gammaScale, quaternionDisplacementScale, twistBendFactor);
+	solveStrandRange(dof, firstStrand, endStrand, gammaScale, quaternionDisplacementScale, twistBendFactor);
+}
+
+void HairModel_PBD_Cosserat::solveDeterministic(HairDoF &dof, float gammaScale, float quaternionDisplacementScale, float twistBendFactor) const {
+	HairDoF::IndexArray& topo = dof.getTopology();
+
+	int nHairs = topo.size();
+	nHairs--;
+	int nBlocks = HairParallel::numBlocks(nHairs);
+
+	//strands do not share points, so running all iterations of one strand before the next
+	//gives the same update order per point as the global parity passes, at any thread count
+#pragma omp parallel for schedule(static)
+	for (int block = 0; block < nBlocks; block++) {
+		HairHeapGuard guard("HairModel_PBD_Cosserat::solveDeterministic");
+		solveStrandRange(dof, HairParallel::blockBegin(block), HairParallel::blockEnd(block, nHairs), gammaScale, quaternionDisplacementScale, twistBendFactor);
+	}
+}
+
+void HairModel_PBD_Cosserat::solveAdaptive(HairDoF &dof, float gammaScale, float quaternionDisplacementScale, float twistBendFactor) const {
+	HairDoF::IndexArray& topo = dof.getTopology();
+
+	int nHairs = topo.size();
+	nHairs--;
+	int nBlocks = HairParallel::numBlocks(nHairs);
+	HairStrandSolve *strandSolves = mArena.allocate<HairStrandSolve>(nHairs);
+	HairSolverStats *blockStats = mArena.allocate<HairSolverStats>(nBlocks);
+	for (int block = 0; block < nBlocks; block++) new (blockStats + block) HairSolverStats();
+
+	//strands stop at different iterations, hence the dynamic schedule; each
+	//strand is solved on one thread, so the result does not depend on it
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int block = 0; block < nBlocks; block++) {
+		HairHeapGuard guard("HairModel_PBD_Cosserat::solveAdaptive");
+		int begin = HairParallel::blockBegin(block);
+		int end = HairParallel::blockEnd(block, nHairs);
+		solveStrandRange(dof, begin, end, gammaScale, quaternionDisplacementScale, twistBendFactor, strandSolves + begin);
+
+		HairSolverStats &s = blockStats[block];
+		for (int i = begin; i < end; i++) {
+			const HairStrandSolve &strand = strandSolves[i];
+			s.iterations += strand.iterations;
+			if (strand.iterations > s.maxIterations) s.maxIterations = strand.iterations;
+			if (strand.converged) s.converged++;
+			s.residual.add(strand.residual);
+		}
+	}
+
+	mStats = HairSolverStats();
+	for (int block = 0; block < nBlocks; block++) {
+		const HairSolverStats &s = blockStats[block];
+		mStats.iterations += s.iterations;
+		if (s.maxIterations > mStats.maxIterations) mStats.maxIterations = s.maxIterations;
+		mStats.converged += s.converged;
+		mStats.residual.add(s.residual);
+	}
+	mStats.strands = nHairs;
+	mStats.strandSolves = strandSolves;
+}
+
+void HairModel_PBD_Cosserat::solveStrandRange(HairDoF &dof, int firstStrand, int endStrand, float gammaScale, float quaternionDisplacementScale, float twistBendFactor, HairStrandSolve *strandSolves) const {
+	HairDoF::IndexArray& topo = dof.getTopology();
+	bool adaptive = isAdaptive();
+
+	for (int hid = firstStrand; hid < endStrand; hid++) {
+		int start = topo[hid];
+		int end = topo[hid + 1];
+		int firstEven = start + (start & 1);
+		int firstOdd = start + 1 - (start & 1);
+
+		//the residual is gathered during the passes, so checking it costs no extra sweep
+		HairResidual residual, initial;
+		HairResidual *tracked = adaptive ? &residual : nullptr;
+		bool converged = false;
+		auto iter = 0u;
+		while (iter < mStiffness && !converged) {
+			residual = HairResidual();
+			for (int pid = firstEven; pid < end; pid += 2) solveStrand(dof, pid, gammaScale, quaternionDisplacementScale, twistBendFactor, tracked);
+			for (int pid = firstOdd; pid < end; pid += 2) solveStrand(dof, pid, gammaScale, quaternionDisplacementScale, twistBendFactor, tracked);
+			if (iter == 0) initial = residual;
+			iter++;
+			converged = adaptive && isConverged(residual, initial, iter);
+		}
+
+		if (strandSolves) {
+			strandSolves[hid - firstStrand].iterations = iter;
+			strandSolves[hid - firstStrand].converged = converged;
+			strandSolves[hid - firstStrand].residual = residual;
+		}
 	}
 }
\ No newline at end of file
@@ -0,0 +1,198 @@
+#include "HairSweep.h"
+#include "HairParallel.h"
+#include "HairRandom.h"
+#include "HairWorld.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace {
+
+double secondsSince(const std::chrono::steady_clock::time_point &start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::unique_ptr<HairDoF> makeDoF(bool quaternions) {
+	if (quaternions) return std::unique_ptr<HairDoF>(new HairDoF_PointsAndQuaternions());
+	return std::unique_ptr<HairDoF>(new HairDoF_Points());
+}
+
+std::unique_ptr<HairModel> cloneModel(const HairModel &prototype) {
+	if (const HairModel_PBD_Cosserat *m = dynamic_cast<const HairModel_PBD_Cosserat *>(&prototype))
+		return std::unique_ptr<HairModel>(new HairModel_PBD_Cosserat(*m));
+	if (const HairModel_FollowTheLeader *m = dynamic_cast<const HairModel_FollowTheLeader *>(&prototype))
+		return std::unique_ptr<HairModel>(new HairModel_FollowTheLeader(*m));
+	return nullptr;
+}
+
+//segment errors of one run, and whether it is still finite
+void measure(HairDoF &dof, float segmentLength, float unstableError, HairSweep::Result &r) {
+	HairDoF::DoFArray &coords = dof.getDoFs();
+	HairDoF::IndexArray &topo = dof.getTopology();
+	auto vtxSize = dof.vertexSize();
+	int nStrands = topo.size() - 1;
+
+	bool finite = true;
+	float maxError = 0;
+	double sumError = 0;
+	unsigned int nSegments = 0;
+	for (int i = 0; i < nStrands && finite; i++) {
+		for (int p = topo[i]; p < topo[i + 1]; p++) {
+			Eigen::Map<const Eigen::Vector3f> b(coords.data() + p * vtxSize);
+			if (!b.allFinite()) {
+				finite = false;
+				break;
+			}
+			if (p == topo[i]) continue;
+
+			Eigen::Map<const Eigen::Vector3f> a(coords.data() + (p - 1) * vtxSize);
+			float error = std::abs((b - a).norm() - segmentLength) / segmentLength;
+			maxError = std::max(maxError, error);
+			sumError += error;
+			nSegments++;
+		}
+	}
+
+	r.stable = finite && maxError <= unstableError;
+	if (!finite) {
+		r.maxError = INFINITY;
+		r.meanError = INFINITY;
+		return;
+	}
+	r.maxError = maxError;
+	r.meanError = nSegments > 0 ? (float)(sumError / nSegments) : 0;
+}
+
+}
+
+HairSweep::HairSweep() : mBatchSize(0), mCheckInterval(10), mUnstableError(1.0f), mSeconds(0) {}
+
+void HairSweep::addGrid(const std::vector<float> &timesteps, const std::vector<float> &segmentLengths, const std::vector<unsigned int> &stiffnesses, const std::vector<float> &hairRadii) {
+	for (auto timestep : timesteps)
+		for (auto segmentLength : segmentLengths)
+			for (auto stiffness : stiffnesses)
+				for (auto hairRadius : hairRadii) {
+					Params p = { timestep, segmentLength, stiffness, hairRadius };
+					mRuns.push_back(p);
+				}
+}
+
+void HairSweep::addRandom(unsigned int count, const Params &lo, const Params &hi, unsigned int seed) {
+	HairRandom rng(seed);
+	for (auto i = 0u; i < count; i++) {
+		HairRandom::Stream random = rng.stream(i);
+		Params p;
+		p.timestep = random.uniform(lo.timestep, hi.timestep);
+		p.segmentLength = random.uniform(lo.segmentLength, hi.segmentLength);
+		p.stiffness = lo.stiffness + std::min(hi.stiffness - lo.stiffness, (unsigned int)(random.uniform() * (hi.stiffness - lo.stiffness + 1)));
+		p.hairRadius = random.uniform(lo.hairRadius, hi.hairRadius);
+		mRuns.push_back(p);
+	}
+}
+
+bool HairSweep::run(const HairGeo &groom, const HairModel &prototype, unsigned int steps) {
+	auto start = std::chrono::steady_clock::now();
+	mResults.clear();
+
+	int nStrands = (int)groom.numStrands();
+	bool quaternions = dynamic_cast<const HairModel_PBD_Cosserat *>(&prototype) != nullptr;
+	if (nStrands == 0 || !cloneModel(prototype)) {
+		std::cout << "HairSweep error: need a groom and a known model type" << std::endl;
+		return false;
+	}
+
+	//topology and point types, read by all runs
+	std::shared_ptr<HairDoF> shared(makeDoF(false).release());
+	shared->setTopology(groom.offsets.data(), nStrands);
+	HairDoF::IndexArray &topo = shared->getTopology();
+	HairDoF::IndexArray &types = shared->getPointType();
+	auto vtxSize = quaternions ? 7u : 3u;
+	Eigen::Index nValues = (Eigen::Index)topo[nStrands] * vtxSize;
+
+	unsigned int nRuns = (unsigned int)mRuns.size();
+	unsigned int batchSize = mBatchSize > 0 ? mBatchSize : 4 * std::max(1u, std::thread::hardware_concurrency());
+	unsigned int checkInterval = std::max(1u, mCheckInterval);
+	mResults.resize(nRuns);
+
+	for (auto first = 0u; first < nRuns; first += batchSize) {
+		unsigned int end = std::min(nRuns, first + batchSize);
+		HairWorld world;
+
+		for (auto r = first; r < end; r++) {
+			const Params &params = mRuns[r];
+			std::unique_ptr<HairDoF> dof = makeDoF(quaternions);
+			dof->getTopology().alias(topo.data(), topo.size(), shared);
+			dof->getPointType().alias(types.data(), types.size(), shared);
+			dof->getDoFs().resize(nValues);
+			dof->getPrevDoFs().resize(nValues);
+			dof->mHairRadius = params.hairRadius;
+
+			//rest pose for this run's segment length
+			float *coords = dof->getDoFs().data();
+#pragma omp parallel for schedule(static)
+			for (int i = 0; i < nStrands; i++) {
+				unsigned int n = groom.offsets[i + 1] - groom.offsets[i];
+				HairGeo::resampleStrand((const float *)(groom.points.data() + groom.offsets[i]), n, 3, coords + (size_t)topo[i] * vtxSize, n, vtxSize, params.segmentLength);
+			}
+			dof->extraInitialize();
+			HairParallel::copy(dof->getPrevDoFs().data(), coords, sizeof(float) * (size_t)nValues);
+
+			std::unique_ptr<HairModel> model = cloneModel(prototype);
+			model->reset();
+			model->mTimestep = params.timestep;
+			model->mSegmentLength = params.segmentLength;
+			model->mStiffness = params.stiffness;
+
+			world.addAsset("run " + std::to_string(r), std::move(dof), std::move(model), makeDoF(quaternions));
+
+			Result &result = mResults[r];
+			result.params = params;
+			result.stable = true;
+			result.steps = 0;
+			result.maxError = 0;
+			result.meanError = 0;
+			result.secondsPerStep = 0;
+		}
+
+		int nBatch = (int)(end - first);
+		for (auto s = 1u; s <= steps; s++) {
+			world.step();
+			if (s % checkInterval != 0 && s != steps) continue;
+
+			//one run per thread; the runs are small
+			int nEnabled = 0;
+#pragma omp parallel for schedule(dynamic, 1) reduction(+:nEnabled)
+			for (int b = 0; b < nBatch; b++) {
+				HairWorld::Asset &asset = world.asset(b);
+				if (!asset.enabled) continue;
+				Result &result = mResults[first + b];
+				result.steps = s;
+				measure(*asset.dof, asset.model->mSegmentLength, mUnstableError, result);
+				asset.enabled = result.stable;
+				if (asset.enabled) nEnabled++;
+			}
+			if (nEnabled == 0) break;
+		}
+
+		for (int b = 0; b < nBatch; b++) {
+			Result &result = mResults[first + b];
+			if (result.steps > 0) result.secondsPerStep = world.asset(b).totalSeconds / result.steps;
+		}
+	}
+
+	mSeconds = secondsSince(start);
+	return true;
+}
+
+void HairSweep::writeTable(std::ostream &out) const {
+	out << "run,timestep,segment_length,stiffness,hair_radius,stable,steps,max_error,mean_error,ms_per_step" << std::endl;
+	for (auto r = 0u; r < mResults.size(); r++) {
+		const Result &result = mResults[r];
+		out << r << ',' << result.params.timestep << ',' << result.params.segmentLength << ',' << result.params.stiffness << ',' << result.params.hairRadius << ','
+			<< (result.stable ? 1 : 0) << ',' << result.steps << ',' << result.maxError << ',' << result.meanError << ',' << result.secondsPerStep * 1000.0 << std::endl;
+	}
+}
@@ -0,0 +1,161 @@
+#include "HairWorld.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <thread>
+
+namespace {
+
+double secondsSince(const std::chrono::steady_clock::time_point &start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+HairWorld::HairWorld() : mStepSeconds(0), mMinTaskCost(1 << 16) {}
+
+unsigned int HairWorld::addAsset(const std::string &name, std::unique_ptr<HairDoF> dof, std::unique_ptr<HairModel> model, std::unique_ptr<HairDoF> roots) {
+	Asset a;
+	a.name = name;
+	a.dof = std::move(dof);
+	a.model = std::move(model);
+	a.roots = std::move(roots);
+	a.enabled = true;
+	a.stepSeconds = 0;
+	a.totalSeconds = 0;
+
+	if (a.roots) a.roots->copyRootsFromHair(*a.dof);
+
+	mAssets.push_back(std::move(a));
+	return (unsigned int)mAssets.size() - 1;
+}
+
+unsigned int HairWorld::addAsset(const std::string &name, HairDoF &dof, HairModel &model, HairDoF *roots) {
+	//owners that never delete
+	auto borrow = [](HairDoF *d) { return std::shared_ptr<HairDoF>(d, [](HairDoF *) {}); };
+	Asset a;
+	a.name = name;
+	a.dof = borrow(&dof);
+	a.model = std::shared_ptr<HairModel>(&model, [](HairModel *) {});
+	if (roots) a.roots = borrow(roots);
+	a.enabled = true;
+	a.stepSeconds = 0;
+	a.totalSeconds = 0;
+
+	mAssets.push_back(std::move(a));
+	return (unsigned int)mAssets.size() - 1;
+}
+
+void HairWorld::clear() {
+	mAssets.clear();
+	mRanges.clear();
+	mTasks.clear();
+}
+
+void HairWorld::schedule() {
+	mRanges.clear();
+	mTasks.clear();
+
+	//cost of a point: integration plus the solver passes over it
+	double *costs = mScratch.allocate<double>(mAssets.size());
+	unsigned int *small = mScratch.allocate<unsigned int>(mAssets.size());
+	unsigned int nSmall = 0;
+	double total = 0;
+	for (auto a = 0u; a < mAssets.size(); a++) {
+		costs[a] = 0;
+		if (!mAssets[a].enabled) continue;
+		HairDoF::IndexArray &topo = mAssets[a].dof->getTopology();
+		if (topo.size() < 2) continue;
+		costs[a] = (double)topo[topo.size() - 1] * (2 + mAssets[a].model->mStiffness);
+		total += costs[a];
+	}
+
+	unsigned int nThreads = std::max(1u, std::thread::hardware_concurrency());
+	double target = std::max((double)mMinTaskCost, total / (4.0 * nThreads));
+
+	//large assets: strand ranges of about the target cost
+	for (auto a = 0u; a < mAssets.size(); a++) {
+		if (costs[a] == 0) continue;
+		if (costs[a] < target) {
+			small[nSmall++] = a;
+			continue;
+		}
+
+		HairDoF::IndexArray &topo = mAssets[a].dof->getTopology();
+		int nHairs = topo.size() - 1;
+		int nParts = (int)std::ceil(costs[a] / target);
+		double pointsPerPart = (double)topo[nHairs] / nParts;
+
+		int first = 0;
+		for (int p = 1; p <= nParts && first < nHairs; p++) {
+			int end = nHairs;
+			if (p < nParts) {
+				int boundary = (int)(p * pointsPerPart);
+				end = (int)(std::lower_bound(topo.data(), topo.data() + nHairs, boundary) - topo.data());
+				if (end <= first) continue;
+			}
+			mTasks.push_back((int)mRanges.size());
+			Range r = { a, first, end };
+			mRanges.push_back(r);
+			first = end;
+		}
+	}
+
+	//small assets: largest first, packed into tasks up to the target cost
+	std::sort(small, small + nSmall, [&](unsigned int x, unsigned int y) { return costs[x] > costs[y]; });
+	double taskCost = target;
+	for (auto i = 0u; i < nSmall; i++) {
+		unsigned int a = small[i];
+		if (taskCost + costs[a] > target) {
+			mTasks.push_back((int)mRanges.size());
+			taskCost = 0;
+		}
+		Range r = { a, 0, (int)mAssets[a].dof->getTopology().size() - 1 };
+		mRanges.push_back(r);
+		taskCost += costs[a];
+	}
+	mTasks.push_back((int)mRanges.size());
+}
+
+void HairWorld::step() {
+	auto start = std::chrono::steady_clock::now();
+	mScratch.reset();
+	for (auto &a : mAssets) a.model->mArena.reset();
+
+	//roots are cheap and already parallel per asset
+	for (auto &a : mAssets) {
+		if (!a.enabled || !a.roots) continue;
+		a.model->updateRoots(*a.roots);
+		a.roots->copyRootsToHair(*a.dof);
+	}
+
+	schedule();
+	mRangeSeconds.assign(mRanges.size(), 0);
+
+	int nTasks = (int)mTasks.size() - 1;
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int t = 0; t < nTasks; t++) {
+		for (int r = mTasks[t]; r < mTasks[t + 1]; r++) {
+			auto rangeStart = std::chrono::steady_clock::now();
+			const Range &range = mRanges[r];
+			Asset &a = mAssets[range.asset];
+			a.model->stepStrands(*a.dof, range.firstStrand, range.endStrand);
+			mRangeSeconds[r] = secondsSince(rangeStart);
+		}
+	}
+
+	for (auto &a : mAssets) a.stepSeconds = 0;
+	for (auto r = 0u; r < mRanges.size(); r++) mAssets[mRanges[r].asset].stepSeconds += mRangeSeconds[r];
+	for (auto &a : mAssets) a.totalSeconds += a.stepSeconds;
+
+	mStepSeconds = secondsSince(start);
+}
+
+void HairWorld::printTimings() const {
+	std::cout << "HairWorld: " << mAssets.size() << " assets, " << (mTasks.empty() ? 0 : mTasks.size() - 1) << " tasks, step " << mStepSeconds * 1000.0 << " ms" << std::endl;
+	for (auto &a : mAssets) {
+		int nHairs = std::max(0, (int)a.dof->getTopology().size() - 1);
+		std::cout << "  " << a.name << ": " << nHairs << " strands, " << a.stepSeconds * 1000.0 << " ms" << (a.enabled ? "" : " (disabled)") << std::endl;
+	}
+}
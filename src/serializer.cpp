@@ -1,29 +1,266 @@
 #include <nanogui/serializer/core.h>
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 
+#if defined(_WIN32)
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
 NAMESPACE_BEGIN(nanogui)
 
 static const char *serialized_header_id = "SER_V1";
+/* SER_V1 with a codec byte after the offset of every TOC entry */
+static const char *serialized_header_id_v2 = "SER_V2";
 static const int serialized_header_id_length = 6;
 static const int serialized_header_size =
     serialized_header_id_length + sizeof(uint64_t) + sizeof(uint32_t);
 
-Serializer::Serializer(const std::string &filename, bool write_)
+/* Writes reach the file in multiples of this size, at multiples of it */
+static const size_t serialized_write_chunk = 1 << 20;
+
+/* Uncompressed dense matrices are preceded by zeros so that their data, after
+   the uint32 rows and cols, starts at a multiple of this offset. Fields are
+   found through the TOC, so readers of either version skip the padding. */
+static const size_t serialized_matrix_alignment = 16;
+
+/* Codecs of a field. Compressed arrays are a sequence of chunks, each a
+   uint32 raw size and uint32 stored size followed by the stored bytes;
+   equal sizes mean the chunk is stored as it is. */
+enum : uint8_t { codec_none = 0, codec_shuffle_lz = 1 };
+static const size_t codec_chunk = 1 << 18;
+
+/* Byte planes: byte b of element i goes to b * count + i */
+static void shuffle(const uint8_t *src, uint8_t *dst, size_t elementSize, size_t count) {
+    for (size_t b = 0; b < elementSize; ++b)
+        for (size_t i = 0; i < count; ++i)
+            dst[b * count + i] = src[i * elementSize + b];
+}
+
+static void unshuffle(const uint8_t *src, uint8_t *dst, size_t elementSize, size_t count) {
+    for (size_t b = 0; b < elementSize; ++b)
+        for (size_t i = 0; i < count; ++i)
+            dst[i * elementSize + b] = src[b * count + i];
+}
+
+static size_t lzBound(size_t size) { return size + size / 255 + 16; }
+
+static void lzLength(uint8_t *&op, size_t length) {
+    for (; length >= 255; length -= 255)
+        *op++ = 255;
+    *op++ = (uint8_t) length;
+}
+
+static uint32_t load32(const uint8_t *p) { uint32_t v; memcpy(&v, p, 4); return v; }
+
+/* LZ77 with 64K offsets and a 4-byte hash (the LZ4 sequence layout): a token
+   of 4 bit literal and match lengths, the literals, a 16 bit offset. The last
+   sequence has literals only. dst holds lzBound(size) bytes. */
+static size_t lzCompress(const uint8_t *src, size_t size, uint8_t *dst) {
+    const int hashBits = 14;
+    uint32_t table[1 << hashBits];
+    memset(table, 0, sizeof(table));
+
+    const uint8_t *ip = src, *anchor = src, *end = src + size;
+    /* Matches end 4 bytes before the input does */
+    const uint8_t *matchEnd = end - (size < 4 ? size : 4);
+    const uint8_t *limit = size < 12 ? src : end - 12;
+    uint8_t *op = dst;
+
+    while (ip < limit) {
+        uint32_t sequence = load32(ip);
+        uint32_t h = (sequence * 2654435761u) >> (32 - hashBits);
+        const uint8_t *ref = src + table[h];
+        table[h] = (uint32_t) (ip - src);
+        if (ref >= ip || ip - ref > 65535 || load32(ref) != sequence) {
+            /* Skip faster through data that does not compress */
+            ip += 1 + ((ip - anchor) >> 6);
+            continue;
+        }
+
+        const uint8_t *matchStart = ip;
+        ip += 4; ref += 4;
+        while (ip < matchEnd && *ip == *ref) { ++ip; ++ref; }
+
+        size_t literals = (size_t) (matchStart - anchor), match = (size_t) (ip - matchStart) - 4;
+        uint8_t *token = op++;
+        *token = (uint8_t) (((literals < 15 ? literals : 15) << 4) | (match < 15 ? match : 15));
+        if (literals >= 15)
+            lzLength(op, literals - 15);
+        memcpy(op, anchor, literals);
+        op += literals;
+        uint16_t offset = (uint16_t) (ip - ref);
+        memcpy(op, &offset, 2);
+        op += 2;
+        if (match >= 15)
+            lzLength(op, match - 15);
+        anchor = ip;
+    }
+
+    size_t literals = (size_t) (end - anchor);
+    *op++ = (uint8_t) ((literals < 15 ? literals : 15) << 4);
+    if (literals >= 15)
+        lzLength(op, literals - 15);
+    memcpy(op, anchor, literals);
+    return (size_t) (op + literals - dst);
+}
+
+/* Returns false unless src decodes to exactly size bytes */
+static bool lzDecompress(const uint8_t *src, size_t srcSize, uint8_t *dst, size_t size) {
+    const uint8_t *ip = src, *ipEnd = src + srcSize;
+    uint8_t *op = dst, *opEnd = dst + size;
+    auto length = [&](size_t value, size_t &result) {
+        result = value;
+        if (value != 15)
+            return true;
+        uint8_t byte;
+        do {
+            if (ip == ipEnd)
+                return false;
+            byte = *ip++;
+            result += byte;
+        } while (byte == 255);
+        return true;
+    };
+
+    while (ip < ipEnd) {
+        uint8_t token = *ip++;
+        size_t literals, match;
+        if (!length(token >> 4, literals) || literals > (size_t) (ipEnd - ip) ||
+            literals > (size_t) (opEnd - op))
+            return false;
+        memcpy(op, ip, literals);
+        ip += literals;
+        op += literals;
+        if (ip == ipEnd)
+            break;
+
+        uint16_t offset;
+        if (ipEnd - ip < 2)
+            return false;
+        memcpy(&offset, ip, 2);
+        ip += 2;
+        if (!length(token & 15, match))
+            return false;
+        match += 4;
+        if (offset == 0 || offset > (size_t) (op - dst) || match > (size_t) (opEnd - op))
+            return false;
+        /* An overlapping match repeats the last offset bytes; copies from
+           ref never overlap their target, and double in size as they go */
+        const uint8_t *ref = op - offset;
+        while (match > 0) {
+            size_t n = std::min(match, (size_t) (op - ref));
+            memcpy(op, ref, n);
+            op += n;
+            match -= n;
+        }
+    }
+    return op == opEnd;
+}
+
+/* Maps a whole file read-only; returns nullptr on failure */
+static const uint8_t *mapFile(const std::string &filename, size_t &size) {
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return nullptr;
+    LARGE_INTEGER fileSize;
+    HANDLE mapping = nullptr;
+    if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+        mapping = CreateFileMapping(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping)
+        return nullptr;
+    /* The view keeps the file and the mapping alive */
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    size = (size_t) fileSize.QuadPart;
+    return (const uint8_t *) data;
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    struct stat st;
+    void *data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        data = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return nullptr;
+    size = (size_t) st.st_size;
+    return (const uint8_t *) data;
+#endif
+}
+
+static void unmapFile(const uint8_t *data, size_t size) {
+#if defined(_WIN32)
+    (void) size;
+    UnmapViewOfFile(data);
+#else
+    munmap((void *) data, size);
+#endif
+}
+
+Serializer::Serializer(const std::string &filename, bool write_, bool mapped_)
     : mFilename(filename), mWrite(write_), mCompatibility(false) {
-    mFile.open(filename, write_ ? (std::ios::out | std::ios::trunc | std::ios::binary)
-                                : (std::ios::in  | std::ios::binary));
-    if (!mFile.is_open())
-        throw std::runtime_error("Could not open \"" + filename + "\"!");
+    if (mapped_ && !write_) {
+        mMapping = mapFile(filename, mMappingSize);
+        if (!mMapping)
+            throw std::runtime_error("Could not map \"" + filename + "\"!");
+    } else {
+        mFile.open(filename, write_ ? (std::ios::out | std::ios::trunc | std::ios::binary)
+                                    : (std::ios::in  | std::ios::binary));
+        if (!mFile.is_open())
+            throw std::runtime_error("Could not open \"" + filename + "\"!");
+    }
 
-    if (!mWrite)
-        readTOC();
-    seek(serialized_header_size);
+    try {
+        if (mWrite) {
+            /* The header is written last, into the space reserved here */
+            mBuffer.reserve(serialized_write_chunk);
+            mBuffer.assign(serialized_header_size, 0);
+        } else {
+            readTOC();
+            seek(serialized_header_size);
+        }
+    } catch (...) {
+        if (mMapping)
+            unmapFile(mMapping, mMappingSize);
+        throw;
+    }
     mPrefixStack.push_back("");
 }
 
 Serializer::~Serializer() {
+    /* Throwing from a destructor would terminate the program */
+    try {
+        close();
+    } catch (const std::exception &e) {
+        std::cerr << "Serializer: " << e.what() << std::endl;
+    }
+}
+
+void Serializer::close() {
+    if (mClosed)
+        return;
+    mClosed = true;
+
+    if (mMapping) {
+        unmapFile(mMapping, mMappingSize);
+        mMapping = nullptr;
+        return;
+    }
     if (mWrite)
         writeTOC();
+    mFile.close();
+    if (mWrite && mFile.fail())
+        throw std::runtime_error("\"" + mFilename + "\": I/O error while closing the file.");
 }
 
 bool Serializer::isSerializedFile(const std::string &filename) {
@@ -36,6 +273,10 @@ bool Serializer::isSerializedFile(const std::string &filename) {
 }
 
 size_t Serializer::size() {
+    if (mMapping)
+        return mMappingSize;
+    if (mWrite)
+        return (size_t) mWritten + mBuffer.size();
     mFile.seekg(0, std::ios_base::end);
     return (uint64_t) mFile.tellg();
 }
@@ -64,13 +305,14 @@ bool Serializer::get_base(const std::string &name,
         throw std::runtime_error("\"" + mFilename +
                                  "\": not open for reading!");
 
-    std::string fullName = mPrefixStack.back() + name;
+    mKey.assign(mPrefixStack.back());
+    mKey.append(name);
 
-    auto it = mTOC.find(fullName);
+    auto it = mTOC.find(mKey);
     if (it == mTOC.end()) {
         std::string message = "\"" + mFilename +
                               "\": unable to find field named \"" +
-                              fullName + "\"!";
+                              mKey + "\"!";
         if (!mCompatibility)
             throw std::runtime_error(message);
         else
@@ -80,13 +322,14 @@ bool Serializer::get_base(const std::string &name,
     }
 
     const auto &record = it->second;
-    if (record.first != type_id)
+    if (record.type_id != type_id)
         throw std::runtime_error(
-            "\"" + mFilename + "\": field named \"" + fullName +
+            "\"" + mFilename + "\": field named \"" + mKey +
             "\" has an incompatible type (expected \"" + type_id +
-            "\", got \"" + record.first + "\")!");
+            "\", got \"" + record.type_id + "\")!");
 
-    seek((size_t) record.second);
+    seek((size_t) record.offset);
+    mCodec = record.codec;
 
     return true;
 }
@@ -102,29 +345,46 @@ void Serializer::set_base(const std::string &name,
         throw std::runtime_error("\"" + mFilename + "\": field named \"" +
                                  fullName + "\" already exists!");
 
-    mTOC[fullName] = std::make_pair(type_id, (uint64_t) mFile.tellp());
+    /* Only dense matrices are compressed */
+    mCodec = mCompression && type_id[0] == 'M' ? codec_shuffle_lz : codec_none;
+    if (type_id[0] == 'M' && mCodec == codec_none) {
+        static const uint8_t zeros[serialized_matrix_alignment] = { };
+        uint64_t data = mWritten + mBuffer.size() + 2 * sizeof(uint32_t);
+        write(zeros, (serialized_matrix_alignment - data % serialized_matrix_alignment) % serialized_matrix_alignment);
+    }
+    Record &record = mTOC[fullName];
+    record.type_id = type_id;
+    record.offset = mWritten + mBuffer.size();
+    record.codec = mCodec;
 }
 
 void Serializer::writeTOC() {
-    uint64_t trailer_offset = (uint64_t) mFile.tellp();
+    uint64_t trailer_offset = mWritten + mBuffer.size();
     uint32_t nItems = (uint32_t) mTOC.size();
 
-    seek(0);
-    write(serialized_header_id, serialized_header_id_length);
-    write(&trailer_offset, sizeof(uint64_t));
-    write(&nItems, sizeof(uint32_t));
-    seek((size_t) trailer_offset);
+    /* Files without compressed fields stay readable as SER_V1 */
+    bool v2 = false;
+    for (auto const &item : mTOC)
+        v2 |= item.second.codec != codec_none;
 
-    for (auto item : mTOC) {
+    for (auto const &item : mTOC) {
         uint16_t size = (uint16_t) item.first.length();
         write(&size, sizeof(uint16_t));
         write(item.first.c_str(), size);
-        size = (uint16_t) item.second.first.length();
+        size = (uint16_t) item.second.type_id.length();
         write(&size, sizeof(uint16_t));
-        write(item.second.first.c_str(), size);
+        write(item.second.type_id.c_str(), size);
 
-        write(&item.second.second, sizeof(uint64_t));
+        write(&item.second.offset, sizeof(uint64_t));
+        if (v2)
+            write(&item.second.codec, sizeof(uint8_t));
     }
+
+    seek(0);
+    write(v2 ? serialized_header_id_v2 : serialized_header_id, serialized_header_id_length);
+    write(&trailer_offset, sizeof(uint64_t));
+    write(&nItems, sizeof(uint32_t));
+    flush();
 }
 
 void Serializer::readTOC() {
@@ -133,11 +393,13 @@ void Serializer::readTOC() {
     char header[serialized_header_id_length];
 
     read(header, serialized_header_id_length);
-    if (memcmp(header, serialized_header_id, serialized_header_id_length) != 0)
+    bool v2 = memcmp(header, serialized_header_id_v2, serialized_header_id_length) == 0;
+    if (!v2 && memcmp(header, serialized_header_id, serialized_header_id_length) != 0)
         throw std::runtime_error("\"" + mFilename + "\": invalid file format!");
     read(&trailer_offset, sizeof(uint64_t));
     read(&nItems, sizeof(uint32_t));
-    mFile.seekg(trailer_offset);
+    seek((size_t) trailer_offset);
+    mTOC.reserve(nItems);
 
     for (uint32_t i = 0; i < nItems; ++i) {
         std::string field_name, type_id;
@@ -149,12 +411,25 @@ void Serializer::readTOC() {
         read(&size, sizeof(uint16_t)); type_id.resize(size);
         read((char *) type_id.data(), size);
         read(&offset, sizeof(uint64_t));
-
-        mTOC[field_name] = std::make_pair(type_id, offset);
+        uint8_t codec = codec_none;
+        if (v2)
+            read(&codec, sizeof(uint8_t));
+        if (codec > codec_shuffle_lz)
+            throw std::runtime_error("\"" + mFilename + "\": field named \"" +
+                                     field_name + "\" has an unknown codec!");
+
+        Record &record = mTOC[field_name];
+        record.type_id = type_id;
+        record.offset = offset;
+        record.codec = codec;
     }
 }
 
 void Serializer::read(void *p, size_t size) {
+    if (mMapping) {
+        memcpy(p, map(size), size);
+        return;
+    }
     mFile.read((char *) p, size);
     if (!mFile.good())
         throw std::runtime_error("\"" + mFilename +
@@ -162,19 +437,58 @@ void Serializer::read(void *p, size_t size) {
                                  std::to_string(size) + " bytes.");
 }
 
-void Serializer::write(const void *p, size_t size) {
-    mFile.write((char *) p, size);
-    if (!mFile.good())
+static void writeFile(std::fstream &file, const std::string &filename, const void *p, size_t size) {
+    file.write((char *) p, size);
+    if (!file.good())
         throw std::runtime_error(
-            "\"" + mFilename + "\": I/O error while attempting to write " +
+            "\"" + filename + "\": I/O error while attempting to write " +
             std::to_string(size) + " bytes.");
 }
 
+void Serializer::write(const void *p, size_t size) {
+    const uint8_t *data = (const uint8_t *) p;
+    size_t space = serialized_write_chunk - mBuffer.size();
+    if (size < space) {
+        mBuffer.insert(mBuffer.end(), data, data + size);
+        return;
+    }
+
+    /* Complete the buffered chunk, pass whole chunks straight through and
+       keep the rest, so that the file is written in aligned chunks */
+    mBuffer.insert(mBuffer.end(), data, data + space);
+    data += space;
+    size -= space;
+    flush();
+    size_t direct = size - size % serialized_write_chunk;
+    writeFile(mFile, mFilename, data, direct);
+    mWritten += direct;
+    mBuffer.insert(mBuffer.end(), data + direct, data + size);
+}
+
+void Serializer::flush() {
+    writeFile(mFile, mFilename, mBuffer.data(), mBuffer.size());
+    mWritten += mBuffer.size();
+    mBuffer.clear();
+}
+
 void Serializer::seek(size_t pos) {
-    if (mWrite)
+    if (mMapping) {
+        if (pos > mMappingSize)
+            throw std::runtime_error(
+                "\"" + mFilename +
+                "\": I/O error while attempting to seek to offset " +
+                std::to_string(pos) + ".");
+        mPosition = pos;
+        return;
+    }
+
+    if (mWrite) {
+        flush();
         mFile.seekp(pos);
-    else
+        mWritten = pos;
+    } else {
         mFile.seekg(pos);
+    }
 
     if (!mFile.good())
         throw std::runtime_error(
@@ -183,4 +497,93 @@ void Serializer::seek(size_t pos) {
             std::to_string(pos) + ".");
 }
 
+const void *Serializer::map(size_t size) {
+    if (!mMapping)
+        throw std::runtime_error("\"" + mFilename + "\": not memory mapped!");
+    if (size > mMappingSize - mPosition)
+        throw std::runtime_error("\"" + mFilename +
+                                 "\": I/O error while attempting to read " +
+                                 std::to_string(size) + " bytes.");
+    const void *p = mMapping + mPosition;
+    mPosition += size;
+    return p;
+}
+
+void Serializer::writeArray(const void *p, size_t elementSize, size_t count) {
+    size_t size = elementSize * count;
+    if (mCodec == codec_none) {
+        write(p, size);
+        return;
+    }
+
+    /* Chunks hold whole elements */
+    const uint8_t *data = (const uint8_t *) p;
+    size_t chunk = codec_chunk - codec_chunk % elementSize;
+    mScratch.resize(chunk + lzBound(chunk));
+    uint8_t *shuffled = mScratch.data(), *packed = shuffled + chunk;
+    for (size_t pos = 0; pos < size; pos += chunk) {
+        uint32_t rawSize = (uint32_t) std::min(chunk, size - pos);
+        shuffle(data + pos, shuffled, elementSize, rawSize / elementSize);
+        size_t packedSize = lzCompress(shuffled, rawSize, packed);
+        uint32_t storedSize = packedSize < rawSize ? (uint32_t) packedSize : rawSize;
+        write(&rawSize, sizeof(uint32_t));
+        write(&storedSize, sizeof(uint32_t));
+        write(storedSize < rawSize ? packed : data + pos, storedSize);
+    }
+}
+
+void Serializer::readArray(void *p, size_t elementSize, size_t count) {
+    size_t size = elementSize * count;
+    if (mCodec == codec_none) {
+        read(p, size);
+        return;
+    }
+
+    uint8_t *data = (uint8_t *) p;
+    for (size_t pos = 0; pos < size; ) {
+        uint32_t rawSize = 0, storedSize = 0;
+        read(&rawSize, sizeof(uint32_t));
+        read(&storedSize, sizeof(uint32_t));
+        if (rawSize == 0 || rawSize > size - pos || rawSize % elementSize != 0 || storedSize > rawSize)
+            throw std::runtime_error("\"" + mFilename + "\": field named \"" + mKey +
+                                     "\" has a corrupt chunk!");
+
+        if (storedSize == rawSize) {
+            read(data + pos, rawSize);
+        } else {
+            /* Mapped chunks are decompressed in place */
+            mScratch.resize(rawSize + (mMapping ? 0 : storedSize));
+            const uint8_t *packed;
+            if (mMapping) {
+                packed = (const uint8_t *) map(storedSize);
+            } else {
+                read(mScratch.data() + rawSize, storedSize);
+                packed = mScratch.data() + rawSize;
+            }
+            if (!lzDecompress(packed, storedSize, mScratch.data(), rawSize))
+                throw std::runtime_error("\"" + mFilename + "\": field named \"" + mKey +
+                                         "\" has a corrupt chunk!");
+            unshuffle(mScratch.data(), data + pos, elementSize, rawSize / elementSize);
+        }
+        pos += rawSize;
+    }
+}
+
+const void *Serializer::mapArray(size_t elementSize, size_t count, size_t alignment) {
+    if (mCodec == codec_none && mMapping) {
+        const void *p = map(elementSize * count);
+        if ((uintptr_t) p % alignment == 0)
+            return p;
+        /* Written before matrices were padded: dereferencing it would be misaligned */
+        std::unique_ptr<uint8_t[]> data(new uint8_t[elementSize * count]);
+        memcpy(data.get(), p, elementSize * count);
+        mDecoded.push_back(std::move(data));
+        return mDecoded.back().get();
+    }
+    std::unique_ptr<uint8_t[]> data(new uint8_t[elementSize * count]);
+    readArray(data.get(), elementSize, count);
+    mDecoded.push_back(std::move(data));
+    return mDecoded.back().get();
+}
+
 NAMESPACE_END(nanogui)